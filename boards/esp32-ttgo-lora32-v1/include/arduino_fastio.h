@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2018 fcgdam
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @ingroup     boards_esp32_TTGO_LORA_V1
+ * @{
+ *
+ * @file
+ * @brief       Compile-time resolved fast GPIO access for Arduino pins
+ *
+ * `digitalWrite` goes through the Arduino pin map array and the generic
+ * `gpio_t` functions at run time. The functions here are always inlined, so
+ * when the pin number is a constant the compiler folds the pin map lookup,
+ * the set/clear register address and the bit mask, and a write becomes a
+ * single 32 bit store to GPIO_OUT_W1TS/W1TC (GPIO_OUT1_W1TS/W1TC for
+ * GPIO32..39).
+ *
+ * The pin has to be configured as output with `pinMode` or `gpio_init`
+ * before, the fast functions don't touch the pin configuration.
+ *
+ * @author      fcgdam <primalcortex.wordpress.com>
+ */
+
+#ifndef ARDUINO_FASTIO_H
+#define ARDUINO_FASTIO_H
+
+#include <stdint.h>
+
+#include "periph/gpio.h"
+#include "arduino_pinmap.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @name    ESP32 GPIO output and input registers
+ * @{
+ */
+#define ARDUINO_FASTIO_OUT_W1TS     (0x3ff44008UL)  /**< set GPIO0..31 */
+#define ARDUINO_FASTIO_OUT_W1TC     (0x3ff4400cUL)  /**< clear GPIO0..31 */
+#define ARDUINO_FASTIO_OUT1_W1TS    (0x3ff44014UL)  /**< set GPIO32..39 */
+#define ARDUINO_FASTIO_OUT1_W1TC    (0x3ff44018UL)  /**< clear GPIO32..39 */
+#define ARDUINO_FASTIO_IN           (0x3ff4403cUL)  /**< input GPIO0..31 */
+#define ARDUINO_FASTIO_IN1          (0x3ff44040UL)  /**< input GPIO32..39 */
+/** @} */
+
+/**
+ * @brief   Register access helper
+ */
+#define ARDUINO_FASTIO_REG(addr)    (*(volatile uint32_t *)(addr))
+
+/**
+ * @brief   Number of Arduino pins known to ARDUINO_FASTIO_GPIO()
+ */
+#define ARDUINO_FASTIO_NUMOF        (20)
+
+/**
+ * @brief   Evaluates to 0, or breaks the build for a constant pin out of range
+ *
+ * The expression stays constant, so it can be used in initializers. A
+ * non-constant pin is not checked (and must not become a variable length
+ * array), for it the write and read functions ignore GPIO_UNDEF. C has no
+ * constexpr evaluation of __builtin_constant_p() for the array size, there
+ * the check is a bit-field width picked with __builtin_choose_expr(); C++
+ * doesn't allow a type definition in sizeof, but folds the array size.
+ */
+#define ARDUINO_FASTIO_IN_RANGE(p)  ((p) >= 0 && (p) < ARDUINO_FASTIO_NUMOF)
+#ifdef __cplusplus
+#define ARDUINO_FASTIO_CHECK(p) \
+    (0 * sizeof(char[(__builtin_constant_p(p) && \
+                      !ARDUINO_FASTIO_IN_RANGE(p)) ? -1 : 1]))
+#else
+#define ARDUINO_FASTIO_CHECK(p) \
+    (0 * sizeof(struct { int _ : __builtin_choose_expr( \
+        __builtin_constant_p(p), ARDUINO_FASTIO_IN_RANGE(p) ? 1 : -1, 1); }))
+#endif
+
+/**
+ * @brief   Resolve an Arduino pin number to its GPIO
+ *
+ * Folds to a constant for constant pin numbers. A0..A5 are the Arduino pins
+ * 14..19 as in the Arduino pin map. A constant pin outside 0..19 fails to
+ * compile, see ARDUINO_FASTIO_CHECK().
+ */
+#define ARDUINO_FASTIO_GPIO(p) \
+    ((gpio_t)(ARDUINO_FASTIO_CHECK(p) + \
+    ((p) ==  0 ? ARDUINO_PIN_0  : (p) ==  1 ? ARDUINO_PIN_1  : \
+     (p) ==  2 ? ARDUINO_PIN_2  : (p) ==  3 ? ARDUINO_PIN_3  : \
+     (p) ==  4 ? ARDUINO_PIN_4  : (p) ==  5 ? ARDUINO_PIN_5  : \
+     (p) ==  6 ? ARDUINO_PIN_6  : (p) ==  7 ? ARDUINO_PIN_7  : \
+     (p) ==  8 ? ARDUINO_PIN_8  : (p) ==  9 ? ARDUINO_PIN_9  : \
+     (p) == 10 ? ARDUINO_PIN_10 : (p) == 11 ? ARDUINO_PIN_11 : \
+     (p) == 12 ? ARDUINO_PIN_12 : (p) == 13 ? ARDUINO_PIN_13 : \
+     (p) == 14 ? ARDUINO_PIN_A0 : (p) == 15 ? ARDUINO_PIN_A1 : \
+     (p) == 16 ? ARDUINO_PIN_A2 : (p) == 17 ? ARDUINO_PIN_A3 : \
+     (p) == 18 ? ARDUINO_PIN_A4 : (p) == 19 ? ARDUINO_PIN_A5 : \
+     GPIO_UNDEF)))
+
+/**
+ * @brief   Bit mask of an Arduino pin in its register bank
+ *
+ * Use it to build the masks for arduino_fastio_write_mask(). Arduino pins
+ * 5 and 6 (GPIO32, GPIO33) are in bank 1, all others in bank 0.
+ */
+#define ARDUINO_FASTIO_MASK(p)      (1UL << (ARDUINO_FASTIO_GPIO(p) & 0x1f))
+
+/**
+ * @brief   Write a GPIO with a single register store
+ *
+ * @param[in] gpio  GPIO, should be a compile time constant
+ * @param[in] val   0 to clear, != 0 to set
+ *
+ * Does nothing for GPIO_UNDEF, which would otherwise set bit 31 of bank 1.
+ */
+static inline __attribute__((always_inline))
+void arduino_fastio_gpio_write(gpio_t gpio, int val)
+{
+    uint32_t mask = 1UL << (gpio & 0x1f);
+
+    if (gpio == GPIO_UNDEF) {
+        return;
+    }
+
+    if (gpio < 32) {
+        ARDUINO_FASTIO_REG(val ? ARDUINO_FASTIO_OUT_W1TS
+                               : ARDUINO_FASTIO_OUT_W1TC) = mask;
+    }
+    else {
+        ARDUINO_FASTIO_REG(val ? ARDUINO_FASTIO_OUT1_W1TS
+                               : ARDUINO_FASTIO_OUT1_W1TC) = mask;
+    }
+}
+
+/**
+ * @brief   Read a GPIO with a single register load
+ *
+ * @return  0 or 1, 0 for GPIO_UNDEF
+ */
+static inline __attribute__((always_inline))
+int arduino_fastio_gpio_read(gpio_t gpio)
+{
+    if (gpio == GPIO_UNDEF) {
+        return 0;
+    }
+
+    uint32_t in = ARDUINO_FASTIO_REG(gpio < 32 ? ARDUINO_FASTIO_IN
+                                               : ARDUINO_FASTIO_IN1);
+    return (in >> (gpio & 0x1f)) & 1;
+}
+
+/**
+ * @brief   Fast equivalent of `digitalWrite` for constant pin numbers
+ */
+#define digitalWriteFast(pin, val) \
+    arduino_fastio_gpio_write(ARDUINO_FASTIO_GPIO(pin), (val))
+
+/**
+ * @brief   Fast equivalent of `digitalRead` for constant pin numbers
+ */
+#define digitalReadFast(pin) \
+    arduino_fastio_gpio_read(ARDUINO_FASTIO_GPIO(pin))
+
+/**
+ * @brief   Set and clear several pins of bank 0 (GPIO0..31) at once
+ *
+ * All pins in @p set change in one register access, then all pins in
+ * @p clr in a second one. Build the masks with ARDUINO_FASTIO_MASK().
+ */
+static inline __attribute__((always_inline))
+void arduino_fastio_write_mask(uint32_t set, uint32_t clr)
+{
+    if (set) {
+        ARDUINO_FASTIO_REG(ARDUINO_FASTIO_OUT_W1TS) = set;
+    }
+    if (clr) {
+        ARDUINO_FASTIO_REG(ARDUINO_FASTIO_OUT_W1TC) = clr;
+    }
+}
+
+/**
+ * @brief   Set and clear several pins of bank 1 (GPIO32..39) at once
+ */
+static inline __attribute__((always_inline))
+void arduino_fastio_write_mask1(uint32_t set, uint32_t clr)
+{
+    if (set) {
+        ARDUINO_FASTIO_REG(ARDUINO_FASTIO_OUT1_W1TS) = set;
+    }
+    if (clr) {
+        ARDUINO_FASTIO_REG(ARDUINO_FASTIO_OUT1_W1TC) = clr;
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ARDUINO_FASTIO_H */
+/** @} */
@@ -0,0 +1,153 @@
+# Copyright (C) 2018 fcgdam
+#
+# This file is subject to the terms and conditions of the GNU Lesser
+# General Public License v2.1. See the file LICENSE in the top level
+# directory for more details.
+
+"""Pure Python AES-128 and AES-CMAC for the simulators.
+
+Encryption has the same structure as modules/lora_crypto/aes_sw.c (one
+round table plus rotations), so the simulators need nothing outside the
+standard library. Decryption is only needed by the network server to build
+join-accepts and is a plain byte oriented implementation.
+"""
+
+
+def _xtime(a):
+    return ((a << 1) ^ 0x1b) & 0xff if a & 0x80 else a << 1
+
+
+def _make_tables():
+    # S-box from the multiplicative inverse and the affine transform
+    exp = [0] * 256
+    log = [0] * 256
+    x = 1
+    for i in range(255):
+        exp[i] = x
+        log[x] = i
+        x ^= _xtime(x)
+    sbox = []
+    for i in range(256):
+        inv = exp[(255 - log[i]) % 255] if i else 0
+        s = inv
+        for k in range(1, 5):
+            s ^= ((inv << k) | (inv >> (8 - k))) & 0xff
+        sbox.append(s ^ 0x63)
+    te0 = [(_xtime(s) << 24) | (s << 16) | (s << 8) | (_xtime(s) ^ s)
+           for s in sbox]
+    te1 = [((t >> 8) | (t << 24)) & 0xffffffff for t in te0]
+    te2 = [((t >> 16) | (t << 16)) & 0xffffffff for t in te0]
+    te3 = [((t >> 24) | (t << 8)) & 0xffffffff for t in te0]
+    return sbox, te0, te1, te2, te3
+
+
+SBOX, TE0, TE1, TE2, TE3 = _make_tables()
+INV_SBOX = [0] * 256
+for _i, _s in enumerate(SBOX):
+    INV_SBOX[_s] = _i
+
+
+def _gmul(a, b):
+    r = 0
+    while b:
+        if b & 1:
+            r ^= a
+        a = _xtime(a)
+        b >>= 1
+    return r
+
+
+RCON = (0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36)
+
+
+class AES128:
+
+    def __init__(self, key):
+        if len(key) != 16:
+            raise ValueError("AES-128 key must be 16 bytes")
+        rk = [int.from_bytes(key[i:i + 4], 'big') for i in range(0, 16, 4)]
+        for i in range(10):
+            t = rk[-1]
+            t = ((SBOX[(t >> 16) & 0xff] << 24) | (SBOX[(t >> 8) & 0xff] << 16) |
+                 (SBOX[t & 0xff] << 8) | SBOX[t >> 24]) ^ (RCON[i] << 24)
+            rk.append(rk[-4] ^ t)
+            rk.append(rk[-4] ^ rk[-1])
+            rk.append(rk[-4] ^ rk[-1])
+            rk.append(rk[-4] ^ rk[-1])
+        self.rk = rk
+
+    def encrypt(self, block):
+        rk = self.rk
+        s0 = int.from_bytes(block[0:4], 'big') ^ rk[0]
+        s1 = int.from_bytes(block[4:8], 'big') ^ rk[1]
+        s2 = int.from_bytes(block[8:12], 'big') ^ rk[2]
+        s3 = int.from_bytes(block[12:16], 'big') ^ rk[3]
+        for r in range(4, 40, 4):
+            t0 = (TE0[s0 >> 24] ^ TE1[(s1 >> 16) & 0xff] ^
+                  TE2[(s2 >> 8) & 0xff] ^ TE3[s3 & 0xff] ^ rk[r])
+            t1 = (TE0[s1 >> 24] ^ TE1[(s2 >> 16) & 0xff] ^
+                  TE2[(s3 >> 8) & 0xff] ^ TE3[s0 & 0xff] ^ rk[r + 1])
+            t2 = (TE0[s2 >> 24] ^ TE1[(s3 >> 16) & 0xff] ^
+                  TE2[(s0 >> 8) & 0xff] ^ TE3[s1 & 0xff] ^ rk[r + 2])
+            t3 = (TE0[s3 >> 24] ^ TE1[(s0 >> 16) & 0xff] ^
+                  TE2[(s1 >> 8) & 0xff] ^ TE3[s2 & 0xff] ^ rk[r + 3])
+            s0, s1, s2, s3 = t0, t1, t2, t3
+        out = bytearray(16)
+        for i, (a, b, c, d) in enumerate(((s0, s1, s2, s3), (s1, s2, s3, s0),
+                                          (s2, s3, s0, s1), (s3, s0, s1, s2))):
+            w = ((SBOX[a >> 24] << 24) | (SBOX[(b >> 16) & 0xff] << 16) |
+                 (SBOX[(c >> 8) & 0xff] << 8) | SBOX[d & 0xff]) ^ rk[40 + i]
+            out[4 * i:4 * i + 4] = w.to_bytes(4, 'big')
+        return bytes(out)
+
+    def decrypt(self, block):
+        keys = [b''.join(w.to_bytes(4, 'big') for w in self.rk[r:r + 4])
+                for r in range(0, 44, 4)]
+        st = [b ^ k for b, k in zip(block, keys[10])]
+        for rnd in range(9, -1, -1):
+            # InvShiftRows and InvSubBytes
+            st = [INV_SBOX[st[(i % 4) + 4 * (((i // 4) - (i % 4)) % 4)]]
+                  for i in range(16)]
+            st = [b ^ k for b, k in zip(st, keys[rnd])]
+            if rnd:
+                out = []
+                for c in range(4):
+                    a = st[4 * c:4 * c + 4]
+                    out += [_gmul(a[0], 14) ^ _gmul(a[1], 11) ^
+                            _gmul(a[2], 13) ^ _gmul(a[3], 9),
+                            _gmul(a[0], 9) ^ _gmul(a[1], 14) ^
+                            _gmul(a[2], 11) ^ _gmul(a[3], 13),
+                            _gmul(a[0], 13) ^ _gmul(a[1], 9) ^
+                            _gmul(a[2], 14) ^ _gmul(a[3], 11),
+                            _gmul(a[0], 11) ^ _gmul(a[1], 13) ^
+                            _gmul(a[2], 9) ^ _gmul(a[3], 14)]
+                st = out
+        return bytes(st)
+
+
+def _dbl(b):
+    n = int.from_bytes(b, 'big') << 1
+    if n >> 128:
+        n ^= 0x87
+    return (n & ((1 << 128) - 1)).to_bytes(16, 'big')
+
+
+def _xor(a, b):
+    return bytes(x ^ y for x, y in zip(a, b))
+
+
+def cmac(key, msg, aes=None):
+    """AES-CMAC (RFC 4493)."""
+    aes = aes or AES128(key)
+    k1 = _dbl(aes.encrypt(bytes(16)))
+    k2 = _dbl(k1)
+    n = max(1, (len(msg) + 15) // 16)
+    last = msg[(n - 1) * 16:]
+    if len(last) == 16:
+        last = _xor(last, k1)
+    else:
+        last = _xor(last + b'\x80' + bytes(15 - len(last)), k2)
+    x = bytes(16)
+    for i in range(n - 1):
+        x = aes.encrypt(_xor(x, msg[i * 16:i * 16 + 16]))
+    return aes.encrypt(_xor(x, last))
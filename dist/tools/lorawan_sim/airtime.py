@@ -0,0 +1,58 @@
+# Copyright (C) 2018 fcgdam
+#
+# This file is subject to the terms and conditions of the GNU Lesser
+# General Public License v2.1. See the file LICENSE in the top level
+# directory for more details.
+
+"""LoRa time on air and the EU868 parameters used by the simulators."""
+
+import math
+
+# EU868 data rates: DR -> (spreading factor, bandwidth in Hz)
+EU868_DR = {
+    0: (12, 125000),
+    1: (11, 125000),
+    2: (10, 125000),
+    3: (9, 125000),
+    4: (8, 125000),
+    5: (7, 125000),
+    6: (7, 250000),
+}
+
+# LoRaWAN 1.0 EU868 defaults
+RECEIVE_DELAY1 = 1.0
+RECEIVE_DELAY2 = 2.0
+JOIN_ACCEPT_DELAY1 = 5.0
+JOIN_ACCEPT_DELAY2 = 6.0
+RX2_DR_TTN = 3
+# the receiver stays open for a few preamble symbols in RX1/RX2
+RX_WINDOW_SYMBOLS = 8
+
+# MHDR + FHDR (7 bytes without FOpts) + FPort + MIC
+LORAWAN_OVERHEAD = 13
+
+
+def time_on_air(payload_len, dr, crc=True, coding_rate=1, preamble=8,
+                implicit_header=False):
+    """Time on air in seconds of a LoRa frame (Semtech AN1200.13)."""
+    sf, bw = EU868_DR[dr]
+    tsym = (2 ** sf) / bw
+    de = 1 if (sf >= 11 and bw == 125000) else 0
+    h = 1 if implicit_header else 0
+    num = 8 * payload_len - 4 * sf + 28 + 16 * (1 if crc else 0) - 20 * h
+    symbols = 8 + max(math.ceil(num / (4 * (sf - 2 * de))) * (coding_rate + 4),
+                      0)
+    return (preamble + 4.25) * tsym + symbols * tsym
+
+
+def symbol_time(dr):
+    sf, bw = EU868_DR[dr]
+    return (2 ** sf) / bw
+
+
+def uplink_airtime(app_payload_len, dr):
+    return time_on_air(app_payload_len + LORAWAN_OVERHEAD, dr)
+
+
+def downlink_airtime(app_payload_len, dr):
+    return time_on_air(app_payload_len + LORAWAN_OVERHEAD, dr, crc=False)
@@ -0,0 +1,217 @@
+# Copyright (C) 2018 fcgdam
+#
+# This file is subject to the terms and conditions of the GNU Lesser
+# General Public License v2.1. See the file LICENSE in the top level
+# directory for more details.
+
+"""LoRaWAN 1.0 frame encoding and decoding for the simulators.
+
+Only what the RIOT_TTGO_TTN node and the network server emulator use:
+join-request/accept, data frames with FOpts MAC commands, MIC and payload
+encryption. Multi-byte fields are little endian as on air.
+"""
+
+import struct
+
+from aes import AES128, cmac
+
+JOIN_REQUEST = 0
+JOIN_ACCEPT = 1
+UNCONFIRMED_UP = 2
+UNCONFIRMED_DOWN = 3
+CONFIRMED_UP = 4
+CONFIRMED_DOWN = 5
+
+UPLINK = 0
+DOWNLINK = 1
+
+# MAC command ids
+LINK_CHECK = 0x02
+LINK_ADR = 0x03
+DEV_STATUS = 0x06
+
+# length of the MAC command payloads, without the CID
+MAC_UP_LEN = {LINK_CHECK: 0, LINK_ADR: 1, DEV_STATUS: 2}
+MAC_DOWN_LEN = {LINK_CHECK: 2, LINK_ADR: 4, DEV_STATUS: 0}
+
+# FCtrl bits
+FCTRL_ADR = 0x80
+FCTRL_ADR_ACK_REQ = 0x40
+FCTRL_ACK = 0x20
+FCTRL_FPENDING = 0x10
+
+
+class MicError(Exception):
+    pass
+
+
+class DataFrame:
+    """Decoded data frame."""
+
+    def __init__(self, mtype, devaddr, fcnt, fctrl=0, fopts=b'', fport=None,
+                 payload=b''):
+        self.mtype = mtype
+        self.devaddr = devaddr
+        self.fcnt = fcnt
+        self.fctrl = fctrl
+        self.fopts = fopts
+        self.fport = fport
+        self.payload = payload
+
+    @property
+    def confirmed(self):
+        return self.mtype in (CONFIRMED_UP, CONFIRMED_DOWN)
+
+    @property
+    def ack(self):
+        return bool(self.fctrl & FCTRL_ACK)
+
+
+def mhdr(mtype):
+    return bytes([mtype << 5])
+
+
+def mtype_of(phy):
+    return phy[0] >> 5
+
+
+_aes_cache = {}
+
+
+def _aes(key):
+    # the simulators use few keys but a lot of blocks, keep the schedules
+    aes = _aes_cache.get(key)
+    if aes is None:
+        if len(_aes_cache) > 4096:
+            _aes_cache.clear()
+        aes = _aes_cache[key] = AES128(key)
+    return aes
+
+
+def _block(kind, direction, devaddr, fcnt, last):
+    return struct.pack('<BIBIIBB', kind, 0, direction, devaddr, fcnt,
+                       0, last)
+
+
+def compute_mic(key, direction, devaddr, fcnt, msg):
+    b0 = _block(0x49, direction, devaddr, fcnt, len(msg))
+    return cmac(key, b0 + msg, _aes(key))[:4]
+
+
+def crypt_payload(key, direction, devaddr, fcnt, data):
+    aes = _aes(key)
+    out = bytearray()
+    for i in range(0, len(data), 16):
+        s = aes.encrypt(_block(0x01, direction, devaddr, fcnt, i // 16 + 1))
+        out += bytes(a ^ b for a, b in zip(data[i:i + 16], s))
+    return bytes(out)
+
+
+def encode_join_request(appeui, deveui, devnonce, appkey):
+    msg = mhdr(JOIN_REQUEST) + struct.pack('<QQH', appeui, deveui, devnonce)
+    return msg + cmac(appkey, msg, _aes(appkey))[:4]
+
+
+def decode_join_request(phy):
+    appeui, deveui, devnonce = struct.unpack('<QQH', phy[1:19])
+    return appeui, deveui, devnonce
+
+
+def check_join_request(phy, appkey):
+    return cmac(appkey, phy[:-4], _aes(appkey))[:4] == phy[-4:]
+
+
+def encode_join_accept(appkey, appnonce, netid, devaddr, dlsettings=0,
+                       rxdelay=1):
+    body = (appnonce.to_bytes(3, 'little') + netid.to_bytes(3, 'little') +
+            struct.pack('<IBB', devaddr, dlsettings, rxdelay))
+    mic = cmac(appkey, mhdr(JOIN_ACCEPT) + body, _aes(appkey))[:4]
+    # the server "decrypts" so that the node only needs AES encryption
+    aes = _aes(appkey)
+    clear = body + mic
+    return mhdr(JOIN_ACCEPT) + b''.join(aes.decrypt(clear[i:i + 16])
+                                        for i in range(0, len(clear), 16))
+
+
+def decode_join_accept(phy, appkey):
+    """Returns (appnonce, netid, devaddr, dlsettings, rxdelay)."""
+    aes = _aes(appkey)
+    clear = b''.join(aes.encrypt(phy[i:i + 16]) for i in range(1, len(phy), 16))
+    body, mic = clear[:-4], clear[-4:]
+    if cmac(appkey, phy[:1] + body, aes)[:4] != mic:
+        raise MicError("join-accept MIC")
+    appnonce = int.from_bytes(body[0:3], 'little')
+    netid = int.from_bytes(body[3:6], 'little')
+    devaddr, dlsettings, rxdelay = struct.unpack('<IBB', body[6:12])
+    return appnonce, netid, devaddr, dlsettings, rxdelay
+
+
+def session_keys(appkey, appnonce, netid, devnonce):
+    """Returns (nwkskey, appskey)."""
+    aes = _aes(appkey)
+    tail = (appnonce.to_bytes(3, 'little') + netid.to_bytes(3, 'little') +
+            struct.pack('<H', devnonce))
+    pad = bytes(16 - 1 - len(tail))
+    return (aes.encrypt(b'\x01' + tail + pad),
+            aes.encrypt(b'\x02' + tail + pad))
+
+
+def encode_data(frame, nwkskey, appskey, direction, fcnt32=None):
+    fcnt32 = frame.fcnt if fcnt32 is None else fcnt32
+    fctrl = (frame.fctrl & 0xf0) | len(frame.fopts)
+    msg = mhdr(frame.mtype) + struct.pack('<IBH', frame.devaddr, fctrl,
+                                          fcnt32 & 0xffff) + frame.fopts
+    if frame.fport is not None:
+        key = nwkskey if frame.fport == 0 else appskey
+        msg += bytes([frame.fport]) + crypt_payload(key, direction,
+                                                    frame.devaddr, fcnt32,
+                                                    frame.payload)
+    return msg + compute_mic(nwkskey, direction, frame.devaddr, fcnt32, msg)
+
+
+def peek_devaddr(phy):
+    return struct.unpack('<I', phy[1:5])[0]
+
+
+def decode_data(phy, nwkskey, appskey, direction, fcnt_hint=0):
+    """Decode and check a data frame.
+
+    fcnt_hint is the last 32 bit frame counter seen, used to restore the
+    upper 16 bits of the counter.
+    """
+    devaddr, fctrl, fcnt16 = struct.unpack('<IBH', phy[1:8])
+    fcnt = (fcnt_hint & ~0xffff) | fcnt16
+    if fcnt < fcnt_hint:
+        fcnt += 0x10000
+    msg, mic = phy[:-4], phy[-4:]
+    if compute_mic(nwkskey, direction, devaddr, fcnt, msg) != mic:
+        raise MicError("data frame MIC")
+    foptslen = fctrl & 0x0f
+    fopts = phy[8:8 + foptslen]
+    rest = phy[8 + foptslen:-4]
+    fport = None
+    payload = b''
+    if rest:
+        fport = rest[0]
+        key = nwkskey if fport == 0 else appskey
+        payload = crypt_payload(key, direction, devaddr, fcnt, rest[1:])
+    return DataFrame(mtype_of(phy), devaddr, fcnt, fctrl & 0xf0, fopts,
+                     fport, payload)
+
+
+def parse_mac(data, lengths):
+    """Split MAC commands into (cid, payload) pairs."""
+    cmds = []
+    i = 0
+    while i < len(data):
+        cid = data[i]
+        n = lengths.get(cid)
+        if n is None:
+            break
+        cmds.append((cid, data[i + 1:i + 1 + n]))
+        i += 1 + n
+    return cmds
+
+
+def build_mac(cmds):
+    return b''.join(bytes([cid]) + payload for cid, payload in cmds)
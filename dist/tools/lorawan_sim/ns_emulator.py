@@ -0,0 +1,274 @@
+# Copyright (C) 2018 fcgdam
+#
+# This file is subject to the terms and conditions of the GNU Lesser
+# General Public License v2.1. See the file LICENSE in the top level
+# directory for more details.
+
+"""Minimal LoRaWAN 1.0 network server stand-in.
+
+Enough of a network server to exercise the RIOT_TTGO_TTN node without the
+live TTN: OTAA join (join-accept in JOIN_ACCEPT_DELAY1), ABP sessions,
+frame counter and MIC checks, acks for confirmed uplinks, LinkCheck,
+DevStatus and LinkADR MAC commands and an application downlink queue per
+device (sent in RX1 for Class A, in RX2 at any time for Class C).
+
+The server does not keep a clock, the caller passes the gateway time of
+every uplink and gets back the downlink to send and when to send it.
+"""
+
+import random
+from collections import deque
+
+import airtime
+import lorawan
+
+# demodulation floor in dB per spreading factor (SX127x datasheet)
+REQUIRED_SNR = {7: -7.5, 8: -10.0, 9: -12.5, 10: -15.0, 11: -17.5, 12: -20.0}
+
+ADR_HISTORY = 20
+ADR_MARGIN = 10.0
+ADR_MAX_DR = 5
+
+
+class Downlink:
+    """A frame for the gateway: send phy at time t with data rate dr.
+
+    app is the entry of the application queue it carries (None for MAC
+    only frames), cls the class of the device when it was built.
+    """
+
+    def __init__(self, devaddr, phy, t, dr, window, cls='A', app=None):
+        self.devaddr = devaddr
+        self.phy = phy
+        self.t = t
+        self.dr = dr
+        self.window = window
+        self.cls = cls
+        self.app = app
+
+
+class Device:
+
+    def __init__(self, deveui=None, appeui=None, appkey=None, devaddr=None,
+                 nwkskey=None, appskey=None, cls='A'):
+        self.deveui = deveui
+        self.appeui = appeui
+        self.appkey = appkey
+        self.devaddr = devaddr
+        self.nwkskey = nwkskey
+        self.appskey = appskey
+        self.cls = cls
+        self.devnonces = set()
+        self.fcnt_up = None
+        self.fcnt_down = 0
+        self.dr = None
+        self.snr = deque(maxlen=ADR_HISTORY)
+        self.queue = deque()
+        self.mac_pending = []
+        self.joined_at = None
+
+
+class Stats:
+
+    def __init__(self):
+        self.joins = 0
+        self.join_replays = 0
+        self.uplinks = 0
+        self.duplicates = 0
+        self.mic_errors = 0
+        self.unknown = 0
+        self.acks = 0
+        self.downlinks = 0
+        self.adr_requests = 0
+        # application downlinks per class: queue_downlink() to delivered()
+        self.latency = {'A': [], 'C': []}
+
+
+class NetworkServer:
+
+    def __init__(self, netid=0x000013, rx2_dr=airtime.RX2_DR_TTN,
+                 devstatus_every=0, adr=True, seed=0):
+        self.netid = netid
+        self.rx2_dr = rx2_dr
+        self.devstatus_every = devstatus_every
+        self.adr = adr
+        self.rng = random.Random(seed)
+        self.by_eui = {}
+        self.by_addr = {}
+        self.next_addr = (netid & 0x7f) << 25
+        self.stats = Stats()
+
+    def register_otaa(self, deveui, appeui, appkey, cls='A'):
+        dev = Device(deveui=deveui, appeui=appeui, appkey=appkey, cls=cls)
+        self.by_eui[deveui] = dev
+        return dev
+
+    def register_abp(self, devaddr, nwkskey, appskey, cls='A'):
+        dev = Device(devaddr=devaddr, nwkskey=nwkskey, appskey=appskey,
+                     cls=cls)
+        self.by_addr[devaddr] = dev
+        return dev
+
+    def set_class(self, devaddr, cls):
+        self.by_addr[devaddr].cls = cls
+
+    def queue_downlink(self, devaddr, fport, payload, confirmed=False,
+                       t=None):
+        """Queue application data, t is the time for its latency."""
+        self.by_addr[devaddr].queue.append((fport, payload, confirmed, t))
+
+    def requeue(self, down):
+        """Put the application data of a downlink that was not sent back."""
+        if down.app is not None:
+            self.by_addr[down.devaddr].queue.appendleft(down.app)
+
+    def delivered(self, down, t):
+        """The device received down at time t."""
+        if down.app is not None and down.app[3] is not None:
+            self.stats.latency[down.cls].append(t - down.app[3])
+
+    def uplink(self, phy, t_end, dr, snr):
+        """Handle an uplink received at time t_end (end of the frame).
+
+        Returns a Downlink or None.
+        """
+        mtype = lorawan.mtype_of(phy)
+        if mtype == lorawan.JOIN_REQUEST:
+            return self._join(phy, t_end, dr)
+        if mtype not in (lorawan.UNCONFIRMED_UP, lorawan.CONFIRMED_UP):
+            self.stats.unknown += 1
+            return None
+        dev = self.by_addr.get(lorawan.peek_devaddr(phy))
+        if dev is None:
+            self.stats.unknown += 1
+            return None
+        hint = 0 if dev.fcnt_up is None else dev.fcnt_up
+        try:
+            frame = lorawan.decode_data(phy, dev.nwkskey, dev.appskey,
+                                        lorawan.UPLINK, hint)
+        except lorawan.MicError:
+            self.stats.mic_errors += 1
+            return None
+        if dev.fcnt_up is not None and frame.fcnt <= dev.fcnt_up:
+            # retransmission of a confirmed frame still needs its ack
+            self.stats.duplicates += 1
+            if not (frame.confirmed and frame.fcnt == dev.fcnt_up):
+                return None
+        else:
+            self.stats.uplinks += 1
+            dev.fcnt_up = frame.fcnt
+        dev.dr = dr
+        dev.snr.append(snr)
+
+        answers = []
+        for cid, payload in lorawan.parse_mac(frame.fopts,
+                                              lorawan.MAC_UP_LEN):
+            if cid == lorawan.LINK_CHECK:
+                margin = max(0, int(snr - REQUIRED_SNR[self._sf(dr)]))
+                answers.append((lorawan.LINK_CHECK, bytes([margin, 1])))
+        answers += dev.mac_pending
+        dev.mac_pending = []
+        if (self.devstatus_every and
+                dev.fcnt_up % self.devstatus_every == 0):
+            answers.append((lorawan.DEV_STATUS, b''))
+        if self.adr and frame.fctrl & lorawan.FCTRL_ADR:
+            adr = self._adr(dev, dr)
+            if adr is not None:
+                answers.append(adr)
+
+        fport = payload = app = None
+        confirmed = False
+        if dev.queue:
+            app = dev.queue.popleft()
+            fport, payload, confirmed, _ = app
+        if not answers and fport is None and not frame.confirmed:
+            return None
+
+        fctrl = lorawan.FCTRL_ACK if frame.confirmed else 0
+        if dev.queue:
+            fctrl |= lorawan.FCTRL_FPENDING
+        if frame.confirmed:
+            self.stats.acks += 1
+        down = self._data_down(dev, fctrl, lorawan.build_mac(answers),
+                               fport, payload or b'', confirmed)
+        self.stats.downlinks += 1
+        return Downlink(dev.devaddr, down, t_end + airtime.RECEIVE_DELAY1, dr,
+                        1, dev.cls, app)
+
+    def class_c_downlink(self, devaddr, t):
+        """Next queued downlink of a Class C device, sent in RX2 at t."""
+        dev = self.by_addr[devaddr]
+        if dev.cls != 'C' or not dev.queue:
+            return None
+        app = dev.queue.popleft()
+        fport, payload, confirmed, _ = app
+        fctrl = lorawan.FCTRL_FPENDING if dev.queue else 0
+        down = self._data_down(dev, fctrl, b'', fport, payload, confirmed)
+        self.stats.downlinks += 1
+        return Downlink(devaddr, down, t, self.rx2_dr, 2, 'C', app)
+
+    def _join(self, phy, t_end, dr):
+        appeui, deveui, devnonce = lorawan.decode_join_request(phy)
+        dev = self.by_eui.get(deveui)
+        if dev is None or dev.appeui != appeui:
+            self.stats.unknown += 1
+            return None
+        if not lorawan.check_join_request(phy, dev.appkey):
+            self.stats.mic_errors += 1
+            return None
+        if devnonce in dev.devnonces:
+            self.stats.join_replays += 1
+            return None
+        dev.devnonces.add(devnonce)
+
+        if dev.devaddr is None:
+            dev.devaddr = self.next_addr
+            self.next_addr += 1
+        else:
+            self.by_addr.pop(dev.devaddr, None)
+        self.by_addr[dev.devaddr] = dev
+        appnonce = self.rng.getrandbits(24)
+        dev.nwkskey, dev.appskey = lorawan.session_keys(dev.appkey, appnonce,
+                                                        self.netid, devnonce)
+        dev.fcnt_up = None
+        dev.fcnt_down = 0
+        dev.snr.clear()
+        dev.mac_pending = []
+        dev.joined_at = t_end
+        self.stats.joins += 1
+        # RX1DROffset 0 and RX2 data rate in DLSettings, RxDelay 1 s
+        phy = lorawan.encode_join_accept(dev.appkey, appnonce, self.netid,
+                                         dev.devaddr, self.rx2_dr & 0x0f, 1)
+        self.stats.downlinks += 1
+        return Downlink(dev.devaddr, phy,
+                        t_end + airtime.JOIN_ACCEPT_DELAY1, dr, 1)
+
+    def _data_down(self, dev, fctrl, fopts, fport, payload, confirmed):
+        mtype = lorawan.CONFIRMED_DOWN if confirmed else \
+            lorawan.UNCONFIRMED_DOWN
+        frame = lorawan.DataFrame(mtype, dev.devaddr, dev.fcnt_down, fctrl,
+                                  fopts, fport, payload)
+        phy = lorawan.encode_data(frame, dev.nwkskey, dev.appskey,
+                                  lorawan.DOWNLINK)
+        dev.fcnt_down += 1
+        return phy
+
+    @staticmethod
+    def _sf(dr):
+        return airtime.EU868_DR[dr][0]
+
+    def _adr(self, dev, dr):
+        # Semtech's recommended algorithm without the TX power steps
+        if len(dev.snr) < ADR_HISTORY:
+            return None
+        margin = max(dev.snr) - REQUIRED_SNR[self._sf(dr)] - ADR_MARGIN
+        steps = int(margin // 3)
+        new_dr = min(ADR_MAX_DR, dr + max(0, steps))
+        if new_dr == dr:
+            return None
+        dev.snr.clear()
+        self.stats.adr_requests += 1
+        # DataRate_TXPower, ChMask for the three default channels,
+        # Redundancy with NbTrans 0 (keep)
+        return (lorawan.LINK_ADR, bytes([(new_dr << 4) | 0x0f, 0x07, 0x00,
+                                         0x00]))
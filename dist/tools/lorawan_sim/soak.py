@@ -0,0 +1,553 @@
+#!/usr/bin/env python3
+
+# Copyright (C) 2018 fcgdam
+#
+# This file is subject to the terms and conditions of the GNU Lesser
+# General Public License v2.1. See the file LICENSE in the top level
+# directory for more details.
+
+"""Fleet soak test of RIOT_TTGO_TTN nodes against the network server stand-in.
+
+Runs hundreds of simulated nodes, one gateway and ns_emulator.NetworkServer
+in a discrete event simulation, offline and much faster than real time. The
+frames on the simulated air are the real LoRaWAN frames (join-request and
+accept, MIC, encrypted payloads, MAC commands), only the radio is modelled.
+
+Each node follows examples/RIOT_TTGO_TTN/main.c: OTAA join at DR1, 60 s
+sleep after a failed join, 4 + 2 s until the first uplink of "This is
+RIOT!", then the next uplink PERIOD seconds after the previous send
+returned (after RX2). The 1% duty cycle of the g1 sub-band is enforced.
+
+Radio model:
+
+- log-distance path loss (PL(1 km) = 128.95 dB, exponent 2.32) with
+  log-normal shadowing, 14 dBm TX power, nodes spread over a disc
+- a frame is received if its SNR is above the demodulation floor of its
+  spreading factor, plus a uniform random loss (--loss)
+- collisions of frames overlapping on the same channel and spreading
+  factor: 'none', 'overlap' (all overlapping frames are lost) or 'capture'
+  (a frame survives if it is 6 dB above every frame it overlaps with)
+- the gateway is half-duplex, uplinks overlapping a downlink are lost and
+  a downlink that would overlap another one moves to RX2 or is dropped
+
+    ./soak.py --nodes 300 --duration 3600
+    ./soak.py --nodes 500 --confirmed --collisions overlap --loss 0.05
+    ./soak.py --nodes 200 --adr --class C --downlink-rate 0.005
+    ./soak.py --nodes 200 --class mixed --downlink-rate 0.01
+
+With --downlink-rate the report has the latency of the application
+downlinks from queue_downlink() at the server to their reception by the
+node, per class: a Class A node gets them in the RX windows of its next
+uplink, a Class C node as soon as it listens on RX2 and the gateway is free.
+--class mixed runs every other node in Class C.
+"""
+
+import argparse
+import heapq
+import math
+import random
+import time
+
+import airtime
+import lorawan
+from ns_emulator import NetworkServer, REQUIRED_SNR
+
+MESSAGE = b"This is RIOT!"
+FPORT = 2
+
+CHANNELS = (868100000, 868300000, 868500000)
+DUTY_CYCLE = 0.01
+TX_POWER = 14.0
+NOISE_FLOOR = -174 + 10 * math.log10(125000) + 6
+CAPTURE_THRESHOLD = 6.0
+JOIN_RETRY = 60.0
+ACK_TIMEOUT = (1.0, 3.0)
+
+
+def path_loss(d):
+    return 128.95 + 23.2 * math.log10(max(d, 1.0) / 1000.0)
+
+
+def percentile(values, p):
+    values = sorted(values)
+    if not values:
+        return float('nan')
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+class Tx:
+    __slots__ = ('node', 'phy', 'start', 'end', 'ch', 'dr', 'rssi', 'lost')
+
+    def __init__(self, node, phy, start, end, ch, dr, rssi):
+        self.node = node
+        self.phy = phy
+        self.start = start
+        self.end = end
+        self.ch = ch
+        self.dr = dr
+        self.rssi = rssi
+        self.lost = None
+
+
+class Node:
+
+    def __init__(self, sim, idx, dist, cls, boot_time):
+        self.sim = sim
+        self.idx = idx
+        self.dist = dist
+        self.cls = cls
+        self.boot_time = boot_time
+        self.deveui = 0x70b3d50000000000 | idx
+        self.appeui = 0x70b3d57ed0000000
+        self.appkey = idx.to_bytes(4, 'big') * 4
+        self.devnonce = sim.rng.getrandbits(16)
+        self.dr = sim.args.dr
+        self.adr = sim.args.adr
+        self.devaddr = None
+        self.nwkskey = self.appskey = None
+        self.fcnt_up = 0
+        self.fcnt_down = 0
+        self.mac_answers = []
+        self.frame_cmds = []
+        self.joined_at = None
+        self.join_requests = 0
+        # rx_token identifies the receive windows of the last transmission
+        self.rx_token = 0
+        self.listening = False
+        self.rx_until = 0.0
+        self.tx_busy_until = 0.0
+        self.dc_free_at = 0.0
+        self.trials = 0
+        self.acked = False
+
+    # air access
+
+    def _transmit(self, t, phy):
+        t = max(t, self.dc_free_at)
+        air = airtime.time_on_air(len(phy), self.dr)
+        self.dc_free_at = t + air / DUTY_CYCLE
+        self.tx_busy_until = t + air
+        self.rx_token += 1
+        self.listening = False
+        self.sim.uplink(self, phy, t, t + air)
+        return t + air
+
+    # join
+
+    def join(self, t):
+        self.devnonce = (self.devnonce + 1) & 0xffff
+        self.join_requests += 1
+        phy = lorawan.encode_join_request(self.appeui, self.deveui,
+                                          self.devnonce, self.appkey)
+        end = self._transmit(t, phy)
+        self.listening = True
+        rx2_close = (end + airtime.JOIN_ACCEPT_DELAY2 +
+                     airtime.RX_WINDOW_SYMBOLS *
+                     airtime.symbol_time(self.sim.args.rx2_dr))
+        self.sim.at(rx2_close, self._join_timeout, self.rx_token)
+
+    def _join_timeout(self, t, token):
+        if token != self.rx_token or self.joined_at is not None:
+            return
+        if t < self.rx_until:
+            # a frame started in the window, wait for its end
+            self.sim.at(self.rx_until, self._join_timeout, token)
+            return
+        self.listening = False
+        self.sim.stats['join_failed'] += 1
+        self.sim.at(t + JOIN_RETRY, self.join)
+
+    def _join_accept(self, t, phy):
+        try:
+            appnonce, netid, devaddr, dls, _ = lorawan.decode_join_accept(
+                phy, self.appkey)
+        except lorawan.MicError:
+            self.sim.stats['down_mic_errors'] += 1
+            return
+        self.devaddr = devaddr
+        self.nwkskey, self.appskey = lorawan.session_keys(
+            self.appkey, appnonce, netid, self.devnonce)
+        self.fcnt_up = self.fcnt_down = 0
+        self.joined_at = t
+        self.listening = False
+        self.rx_token += 1
+        self.sim.joined(self, t)
+        # xtimer_sleep(4), class switch, xtimer_sleep(2), first send
+        if self.cls == 'C':
+            self.sim.ns.set_class(devaddr, 'C')
+        self.sim.at(t + 6.0, self.send)
+
+    # data
+
+    def send(self, t):
+        self.trials = 0
+        self.acked = False
+        # MAC answers go with the next new frame and its retransmissions
+        self.frame_cmds = self.mac_answers
+        self.mac_answers = []
+        self._send_frame(t)
+
+    def _send_frame(self, t):
+        confirmed = self.sim.args.confirmed
+        fctrl = lorawan.FCTRL_ADR if self.adr else 0
+        cmds = self.frame_cmds
+        linkcheck = self.sim.args.linkcheck
+        if linkcheck and self.trials == 0 and self.fcnt_up % linkcheck == 0:
+            cmds = cmds + [(lorawan.LINK_CHECK, b'')]
+        frame = lorawan.DataFrame(lorawan.CONFIRMED_UP if confirmed else
+                                  lorawan.UNCONFIRMED_UP, self.devaddr,
+                                  self.fcnt_up, fctrl,
+                                  lorawan.build_mac(cmds), FPORT, MESSAGE)
+        phy = lorawan.encode_data(frame, self.nwkskey, self.appskey,
+                                  lorawan.UPLINK)
+        self.trials += 1
+        self.sim.stats['uplinks_sent'] += 1
+        if self.trials > 1:
+            self.sim.stats['retransmissions'] += 1
+        end = self._transmit(t, phy)
+        self.listening = True
+        rx2_close = (end + airtime.RECEIVE_DELAY2 +
+                     airtime.RX_WINDOW_SYMBOLS *
+                     airtime.symbol_time(self.sim.args.rx2_dr))
+        self.sim.at(rx2_close, self._rx_done, self.rx_token)
+
+    def _rx_done(self, t, token):
+        if token != self.rx_token:
+            return
+        if t < self.rx_until:
+            self.sim.at(self.rx_until, self._rx_done, token)
+            return
+        # the RX windows are over, Class C keeps listening on RX2
+        self.listening = self.cls == 'C'
+        if self.sim.args.confirmed and not self.acked:
+            if self.trials < self.sim.args.retries:
+                self.sim.at(t + self.sim.rng.uniform(*ACK_TIMEOUT),
+                            self._send_frame)
+                return
+            self.sim.stats['unacked'] += 1
+        self.fcnt_up += 1
+        # semtech_loramac_send() returned, the RTC alarm fires PERIOD later
+        self.sim.at(t + self.sim.args.period, self.send)
+
+    def detect(self, t, air):
+        """A downlink starts at t, True if the node picks up its preamble."""
+        if not self.listening or t < self.tx_busy_until:
+            return False
+        self.rx_until = t + air
+        return True
+
+    def receive(self, t, phy, window):
+        if lorawan.mtype_of(phy) == lorawan.JOIN_ACCEPT:
+            if self.joined_at is None:
+                self._join_accept(t, phy)
+            return False
+        try:
+            frame = lorawan.decode_data(phy, self.nwkskey, self.appskey,
+                                        lorawan.DOWNLINK, self.fcnt_down)
+        except lorawan.MicError:
+            self.sim.stats['down_mic_errors'] += 1
+            return False
+        self.fcnt_down = frame.fcnt + 1
+        self.sim.stats['downlinks_received'] += 1
+        if frame.fport:
+            self.sim.stats['app_downlinks_received'] += 1
+        answers = self.mac_answers
+        fopts = frame.fopts if frame.fport != 0 else frame.payload
+        for cid, payload in lorawan.parse_mac(fopts, lorawan.MAC_DOWN_LEN):
+            if cid == lorawan.LINK_ADR:
+                self.dr = payload[0] >> 4
+                answers.append((lorawan.LINK_ADR, b'\x07'))
+            elif cid == lorawan.DEV_STATUS:
+                answers.append((lorawan.DEV_STATUS, b'\xff\x10'))
+            elif cid == lorawan.LINK_CHECK:
+                self.sim.stats['link_checks'] += 1
+        if frame.ack and not self.acked:
+            self.acked = True
+            self.sim.stats['acks_received'] += 1
+        if window == 1:
+            # RX2 is not opened once RX1 got a frame
+            self.rx_token += 1
+            self._rx_done(t, self.rx_token)
+        return True
+
+
+class Simulation:
+
+    def __init__(self, args):
+        self.args = args
+        self.rng = random.Random(args.seed)
+        self.ns = NetworkServer(rx2_dr=args.rx2_dr,
+                                devstatus_every=args.devstatus,
+                                adr=args.adr, seed=args.seed)
+        self.events = []
+        self.seq = 0
+        self.now = 0.0
+        self.active = []
+        self.gw_tx = []
+        self.stats = {k: 0 for k in (
+            'uplinks_sent', 'retransmissions', 'join_failed',
+            'uplinks_received', 'lost_signal', 'lost_random',
+            'lost_collision', 'lost_half_duplex', 'downlinks_sent',
+            'downlinks_dropped', 'downlinks_lost', 'downlinks_received',
+            'app_downlinks_queued', 'app_downlinks_received',
+            'down_not_listening', 'down_mic_errors', 'acks_received',
+            'unacked', 'link_checks')}
+        self.join_times = []
+        self.nodes = []
+        for i in range(args.nodes):
+            # uniform over the disc
+            d = args.radius * math.sqrt(self.rng.random())
+            boot = self.rng.uniform(0, args.boot_spread)
+            cls = args.lorawan_class
+            if cls == 'mixed':
+                cls = 'C' if i % 2 else 'A'
+            node = Node(self, i, d, cls, boot)
+            self.ns.register_otaa(node.deveui, node.appeui, node.appkey, cls)
+            self.nodes.append(node)
+            self.at(boot, node.join)
+            if args.downlink_rate:
+                self.at(self.rng.expovariate(args.downlink_rate),
+                        self._app_downlink, node)
+
+    def at(self, t, fn, *args):
+        self.seq += 1
+        heapq.heappush(self.events, (t, self.seq, fn, args))
+
+    def run(self):
+        duration = self.args.duration
+        while self.events:
+            t, _, fn, args = heapq.heappop(self.events)
+            if t > duration:
+                break
+            self.now = t
+            fn(t, *args)
+
+    def joined(self, node, t):
+        self.join_times.append(t - node.boot_time)
+
+    # gateway side
+
+    def _rssi(self, node):
+        return (TX_POWER - path_loss(node.dist) +
+                self.rng.gauss(0, self.args.shadowing))
+
+    def uplink(self, node, phy, start, end):
+        tx = Tx(node, phy, start, end, self.rng.randrange(len(CHANNELS)),
+                node.dr, self._rssi(node))
+        self.active = [a for a in self.active if a.end > start]
+        sf = airtime.EU868_DR[tx.dr][0]
+        mode = self.args.collisions
+        for other in self.active:
+            if other.ch != tx.ch or airtime.EU868_DR[other.dr][0] != sf:
+                continue
+            if mode == 'overlap':
+                tx.lost = other.lost = 'collision'
+            elif mode == 'capture':
+                if tx.rssi < other.rssi + CAPTURE_THRESHOLD:
+                    tx.lost = 'collision'
+                if other.rssi < tx.rssi + CAPTURE_THRESHOLD:
+                    other.lost = 'collision'
+        self.active.append(tx)
+        self.at(end, self._uplink_end, tx)
+
+    def _uplink_end(self, t, tx):
+        sf = airtime.EU868_DR[tx.dr][0]
+        snr = tx.rssi - NOISE_FLOOR
+        if snr < REQUIRED_SNR[sf]:
+            self.stats['lost_signal'] += 1
+            return
+        if self.rng.random() < self.args.loss:
+            self.stats['lost_random'] += 1
+            return
+        if tx.lost:
+            self.stats['lost_collision'] += 1
+            return
+        self.gw_tx = [g for g in self.gw_tx if g[1] > tx.start - 10.0]
+        if any(s < tx.end and e > tx.start for s, e in self.gw_tx):
+            self.stats['lost_half_duplex'] += 1
+            return
+        self.stats['uplinks_received'] += 1
+        down = self.ns.uplink(tx.phy, t, tx.dr, snr)
+        if down is not None:
+            self._schedule_downlink(tx.node, down)
+
+    def _gw_free(self, start, end):
+        return not any(s < end and e > start for s, e in self.gw_tx)
+
+    def _schedule_downlink(self, node, down):
+        air = airtime.time_on_air(len(down.phy), down.dr, crc=False)
+        if not self._gw_free(down.t, down.t + air) and down.window == 1:
+            # RX1 taken, try RX2 one second later
+            down.t += 1.0
+            down.dr = self.args.rx2_dr
+            down.window = 2
+            air = airtime.time_on_air(len(down.phy), down.dr, crc=False)
+        if not self._gw_free(down.t, down.t + air):
+            self.stats['downlinks_dropped'] += 1
+            return False
+        self.gw_tx.append((down.t, down.t + air))
+        self.stats['downlinks_sent'] += 1
+        self.at(down.t, self._downlink_start, node, down, air)
+        return True
+
+    def _downlink_start(self, t, node, down, air):
+        if not node.detect(t, air):
+            self.stats['down_not_listening'] += 1
+            return
+        self.at(t + air, self._downlink_end, node, down)
+
+    def _downlink_end(self, t, node, down):
+        rssi = self._rssi(node)
+        if (rssi - NOISE_FLOOR < REQUIRED_SNR[airtime.EU868_DR[down.dr][0]] or
+                self.rng.random() < self.args.loss):
+            self.stats['downlinks_lost'] += 1
+            return
+        if node.receive(t, down.phy, down.window):
+            self.ns.delivered(down, t)
+
+    def _app_downlink(self, t, node):
+        if node.devaddr is not None:
+            self.stats['app_downlinks_queued'] += 1
+            self.ns.queue_downlink(node.devaddr, 1, b'\x01\x02\x03\x04',
+                                   t=t)
+            if node.cls == 'C':
+                self._class_c(t, node)
+        self.at(t + self.rng.expovariate(self.args.downlink_rate),
+                self._app_downlink, node)
+
+    def _class_c(self, t, node):
+        # wait while the node is transmitting or has its RX1 window open
+        if not node.listening or t < node.tx_busy_until:
+            self.at(t + 1.0, self._class_c, node)
+            return
+        down = self.ns.class_c_downlink(node.devaddr, t)
+        if down is not None and not self._schedule_downlink(node, down):
+            self.ns.requeue(down)
+            self.at(t + 1.0, self._class_c, node)
+
+    # report
+
+    def report(self, wall):
+        s = self.stats
+        a = self.args
+        n = len(self.nodes)
+        joined = sum(1 for node in self.nodes if node.joined_at is not None)
+        jt = self.join_times
+        lost = (s['lost_signal'] + s['lost_random'] + s['lost_collision'] +
+                s['lost_half_duplex'])
+        data_sent = s['uplinks_sent']
+        # join-requests go through the same gateway path
+        air_frames = data_sent + sum(node.join_requests for node in self.nodes)
+        ns = self.ns.stats
+
+        print("Simulated %d nodes for %.0f s in %.2f s wall time "
+              "(%.0fx real time)" % (n, a.duration, wall, a.duration / wall))
+        print("Channel: %s collisions, %.0f%% random loss, %.0f m radius, "
+              "DR%d%s" % (a.collisions, 100 * a.loss, a.radius, a.dr,
+                          " + ADR" if a.adr else ""))
+        print()
+        print("Join:       %d/%d joined, %d join-requests, %d failed "
+              "attempts" % (joined, n,
+                            sum(node.join_requests for node in self.nodes),
+                            s['join_failed']))
+        if jt:
+            print("            time to join min %.1f s  avg %.1f s  "
+                  "p50 %.1f s  p95 %.1f s  max %.1f s" %
+                  (min(jt), sum(jt) / len(jt), percentile(jt, 50),
+                   percentile(jt, 95), max(jt)))
+        print("Uplinks:    %d frames on air, %d data uplinks sent "
+              "(%d retransmissions)" % (air_frames, data_sent,
+                                        s['retransmissions']))
+        print("            %d received by the gateway, %d new at the "
+              "server, %d duplicates" % (s['uplinks_received'], ns.uplinks,
+                                         ns.duplicates))
+        if air_frames:
+            print("            PDR %.1f%%  collision rate %.1f%%  "
+                  "lost: signal %d  random %d  collision %d  "
+                  "half-duplex %d" %
+                  (100.0 * (air_frames - lost) / air_frames,
+                   100.0 * s['lost_collision'] / air_frames,
+                   s['lost_signal'], s['lost_random'], s['lost_collision'],
+                   s['lost_half_duplex']))
+        print("Throughput: %.3f frames/s  %.1f application bytes/s fleet, "
+              "%.4f frames/s per node" %
+              (ns.uplinks / a.duration,
+               ns.uplinks * len(MESSAGE) / a.duration,
+               ns.uplinks / a.duration / max(1, n)))
+        print("Downlinks:  %d sent, %d dropped (gateway busy), %d lost, "
+              "%d missed by the node, %d received" %
+              (s['downlinks_sent'], s['downlinks_dropped'],
+               s['downlinks_lost'], s['down_not_listening'],
+               s['downlinks_received']))
+        if a.confirmed:
+            print("Confirmed:  %d acks sent, %d received, %d frames "
+                  "never acked" % (ns.acks, s['acks_received'],
+                                   s['unacked']))
+        if a.downlink_rate:
+            print("App data:   %d queued, %d received" %
+                  (s['app_downlinks_queued'], s['app_downlinks_received']))
+            for cls, lat in sorted(ns.latency.items()):
+                if lat:
+                    print("            Class %s latency (%d) min %.2f s  "
+                          "avg %.2f s  p50 %.2f s  p95 %.2f s  max %.2f s" %
+                          (cls, len(lat), min(lat), sum(lat) / len(lat),
+                           percentile(lat, 50), percentile(lat, 95),
+                           max(lat)))
+        if a.adr or a.linkcheck or a.devstatus:
+            print("MAC:        %d LinkADR, %d LinkCheckAns received" %
+                  (ns.adr_requests, s['link_checks']))
+            drs = {}
+            for node in self.nodes:
+                drs[node.dr] = drs.get(node.dr, 0) + 1
+            print("            final data rates: %s" %
+                  "  ".join("DR%d %d" % kv for kv in sorted(drs.items())))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                        formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--nodes', type=int, default=100)
+    parser.add_argument('--duration', type=float, default=3600.0,
+                        help="simulated time in s")
+    parser.add_argument('--period', type=float, default=20.0,
+                        help="uplink period in s (PERIOD in main.c)")
+    parser.add_argument('--dr', type=int, default=1,
+                        help="initial data rate (LORAMAC_DR_1 in main.c)")
+    parser.add_argument('--rx2-dr', type=int, default=airtime.RX2_DR_TTN)
+    parser.add_argument('--class', dest='lorawan_class', choices=('A', 'C', 'mixed'),
+                        default='A')
+    parser.add_argument('--confirmed', action='store_true',
+                        help="send confirmed uplinks")
+    parser.add_argument('--retries', type=int, default=8,
+                        help="transmissions of a confirmed uplink")
+    parser.add_argument('--adr', action='store_true',
+                        help="nodes request ADR, the server sends LinkADR")
+    parser.add_argument('--linkcheck', type=int, default=0, metavar='N',
+                        help="add a LinkCheckReq every N uplinks")
+    parser.add_argument('--devstatus', type=int, default=0, metavar='N',
+                        help="server sends a DevStatusReq every N uplinks")
+    parser.add_argument('--downlink-rate', type=float, default=0.0,
+                        help="application downlinks per second and node")
+    parser.add_argument('--loss', type=float, default=0.0,
+                        help="uniform packet loss probability")
+    parser.add_argument('--collisions', choices=('none', 'overlap',
+                                                 'capture'),
+                        default='capture')
+    parser.add_argument('--radius', type=float, default=3000.0,
+                        help="nodes are spread over a disc of this radius "
+                             "in m around the gateway")
+    parser.add_argument('--shadowing', type=float, default=4.0,
+                        help="log-normal shadowing sigma in dB")
+    parser.add_argument('--boot-spread', type=float, default=60.0,
+                        help="nodes power up within this many seconds")
+    parser.add_argument('--seed', type=int, default=1)
+    args = parser.parse_args()
+
+    sim = Simulation(args)
+    start = time.time()
+    sim.run()
+    sim.report(time.time() - start)
+
+
+if __name__ == '__main__':
+    main()
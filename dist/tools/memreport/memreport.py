@@ -0,0 +1,230 @@
+#!/usr/bin/env python3
+
+# Copyright (C) 2018 fcgdam
+#
+# This file is subject to the terms and conditions of the GNU Lesser
+# General Public License v2.1. See the file LICENSE in the top level
+# directory for more details.
+
+"""Static RAM and flash used by each RIOT module and package of a build.
+
+Reads the GNU ld map file of an application (the examples write it to
+bin/<board>/<application>.map, see `make memreport`) and adds up the input
+sections that made it into the image, per archive. RIOT builds every module
+into its own archive, so this is the size per module after garbage
+collection of unused sections. Archives of a package (semtech_loramac_mac,
+semtech_loramac_crypto, ...) are summed under the package name when the
+RIOT tree is given, further groups can be added with --group.
+
+Columns are as with `size`: text (code and constants, flash), data
+(initialised variables, flash and RAM), bss (zeroed variables, RAM) and on
+the ESP32 iram (code copied to instruction RAM at boot, flash and RAM).
+
+    ./memreport.py --riotbase $RIOTBASE --group shell bin/*/ttgo_oled_test.map
+    ./memreport.py --detail u8g2 bin/*/ttgo_oled_test.map
+"""
+
+import argparse
+import os
+import re
+import sys
+from collections import defaultdict
+
+KINDS = ('text', 'data', 'bss', 'iram')
+
+SKIP_SECTION = re.compile(r'^\.(debug|comment|stab|xtensa\.info|xt\.|'
+                          r'ARM\.attributes|note|gnu\.attributes)')
+INPUT = re.compile(r'^ (\S+)\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)(?:\s+(.*))?$')
+INPUT_NAME = re.compile(r'^ (\S+)$')
+CONT = re.compile(r'^\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S.*)$')
+OUTPUT = re.compile(r'^(\.\S+)(?:\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+))?')
+ARCHIVE = re.compile(r'^(.*?)\(([^()]+)\)$')
+
+
+def classify(section):
+    """Memory kind of an output section, None if it is not in the image."""
+    n = section.lower()
+    if SKIP_SECTION.match(section):
+        return None
+    if 'bss' in n or 'noinit' in n or n in ('.heap', '.stack'):
+        return 'bss'
+    if 'rodata' in n:
+        return 'text'
+    if 'iram' in n or n.startswith('.rtc.text'):
+        return 'iram'
+    if 'data' in n:
+        return 'data'
+    if ('text' in n or 'vector' in n or 'literal' in n or
+            n.startswith(('.init', '.fini', '.ctors', '.dtors', '.eh_frame',
+                          '.gcc_except_table', '.arm.ex', '.isr_vector',
+                          '.flash.', '.rom'))):
+        return 'text'
+    return None
+
+
+def owner(path):
+    """(module, object) of an input file of the map."""
+    if path is None:
+        return '*fill*', ''
+    m = ARCHIVE.match(path)
+    if m:
+        lib = os.path.basename(m.group(1))
+        obj = m.group(2)
+    else:
+        lib = os.path.basename(path)
+        obj = lib
+    for ext in ('.a', '.o'):
+        if lib.endswith(ext):
+            lib = lib[:-len(ext)]
+    return lib, obj
+
+
+def parse_map(path):
+    """Yields (output section, input section, address, size, file)."""
+    with open(path, errors='replace') as f:
+        lines = iter(f.read().splitlines())
+
+    for line in lines:
+        if line.startswith('Linker script and memory map'):
+            break
+    else:
+        raise ValueError("%s: not a GNU ld map file" % path)
+
+    out = None
+    pending = None
+    for line in lines:
+        if not line:
+            continue
+        if line[0] != ' ':
+            m = OUTPUT.match(line)
+            out = m.group(1) if m else None
+            pending = None
+            continue
+        if out is None:
+            continue
+        if pending is not None:
+            m = CONT.match(line)
+            if m:
+                yield (out, pending, int(m.group(1), 16), int(m.group(2), 16),
+                       m.group(3))
+            pending = None
+            continue
+        m = INPUT.match(line)
+        if m:
+            name, path = m.group(1), m.group(4)
+            if name.startswith('*') and name != '*fill*':
+                continue
+            yield (out, name, int(m.group(2), 16), int(m.group(3), 16),
+                   path if name != '*fill*' else None)
+            continue
+        m = INPUT_NAME.match(line)
+        if m and not m.group(1).startswith('*'):
+            # long section names go on a line of their own
+            pending = m.group(1)
+
+
+def package_names(riotbase):
+    pkgdir = os.path.join(riotbase, 'pkg')
+    if not os.path.isdir(pkgdir):
+        return []
+    return sorted((d.replace('-', '_') for d in os.listdir(pkgdir)
+                   if os.path.isdir(os.path.join(pkgdir, d))),
+                  key=len, reverse=True)
+
+
+def group_of(module, groups):
+    for g in groups:
+        if module == g or module.startswith(g + '_'):
+            return g
+    return module
+
+
+def report(path, args, groups):
+    sizes = defaultdict(lambda: dict.fromkeys(KINDS, 0))
+    detail = defaultdict(int)
+    for out, name, _, size, src in parse_map(path):
+        kind = classify(out)
+        if kind is None or size == 0:
+            continue
+        module, obj = owner(src)
+        module = group_of(module, groups)
+        sizes[module][kind] += size
+        if args.detail and module == args.detail:
+            detail[(obj, name, kind)] += size
+
+    rows = []
+    for module, s in sizes.items():
+        flash = s['text'] + s['data'] + s['iram']
+        ram = s['data'] + s['bss'] + s['iram']
+        rows.append((module, s['text'], s['data'], s['bss'], s['iram'],
+                     flash, ram))
+    key = {'flash': lambda r: -r[5], 'ram': lambda r: -r[6],
+           'name': lambda r: r[0]}[args.sort]
+    rows.sort(key=key)
+    total = [sum(r[i] for r in rows) for i in range(1, 7)]
+    iram = total[3] != 0
+
+    if args.csv:
+        print("map,module,text,data,bss,iram,flash,ram")
+        for r in rows:
+            print("%s,%s,%d,%d,%d,%d,%d,%d" % ((path,) + r))
+        return
+
+    print("%s" % path)
+    head = "%-28s %8s %8s %8s" % ('module', 'text', 'data', 'bss')
+    if iram:
+        head += " %8s" % 'iram'
+    print(head + " %8s %8s" % ('flash', 'ram'))
+    shown = rows[:args.top] if args.top else rows
+    for r in shown + [('total',) + tuple(total)]:
+        if r[0] == 'total':
+            if args.top and len(rows) > args.top:
+                print("(%d more)" % (len(rows) - args.top))
+        line = "%-28s %8d %8d %8d" % r[:4]
+        if iram:
+            line += " %8d" % r[4]
+        print(line + " %8d %8d" % r[5:])
+
+    if args.detail:
+        print()
+        print("%s, largest sections:" % args.detail)
+        items = sorted(detail.items(), key=lambda kv: -kv[1])
+        for (obj, name, kind), size in items[:args.top or 30]:
+            print("  %8d %-4s %-24s %s" % (size, kind, obj, name))
+    print()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                        formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('maps', nargs='+', help="linker map files")
+    parser.add_argument('--riotbase', default=os.environ.get('RIOTBASE'),
+                        help="RIOT tree, to sum up the archives of packages")
+    parser.add_argument('--group', action='append', default=[],
+                        help="sum up the modules NAME and NAME_* (repeat)")
+    parser.add_argument('--sort', choices=('flash', 'ram', 'name'),
+                        default='flash')
+    parser.add_argument('--top', type=int, default=0,
+                        help="only show the N largest modules")
+    parser.add_argument('--detail', metavar='MODULE',
+                        help="list the largest input sections of MODULE")
+    parser.add_argument('--csv', action='store_true')
+    args = parser.parse_args()
+
+    groups = list(args.group)
+    if args.riotbase:
+        groups += package_names(args.riotbase)
+    groups.sort(key=len, reverse=True)
+
+    status = 0
+    for path in args.maps:
+        try:
+            report(path, args, groups)
+        except (OSError, ValueError) as e:
+            print("memreport: %s" % e, file=sys.stderr)
+            status = 1
+    return status
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,333 @@
+#!/usr/bin/env python3
+
+# Copyright (C) 2018 fcgdam
+#
+# This file is subject to the terms and conditions of the GNU Lesser
+# General Public License v2.1. See the file LICENSE in the top level
+# directory for more details.
+
+"""Symbolize the samples of the profiler module.
+
+Reads a terminal log containing the output of `prof dump` (the lines from
+"PROF begin" to "PROF end", anything around them is skipped) and maps the
+sampled program counters to the functions of the application ELF file.
+
+Output formats:
+
+- flat profile (default): samples per function, with the module (archive)
+  of the function when the linker map is given, and per thread totals
+- --folded: "thread;module;function count" lines for flamegraph.pl or
+  speedscope
+- --svg FILE: a flame graph of the same stacks, thread / module / function
+
+The profiler samples only the PC, not the call stack, so the flame graph
+is three levels deep. Time spent in a helper (memcpy, the AES rounds)
+is accounted to the helper, not to its caller.
+
+    ./symbolize.py bin/esp32-ttgo-lora32-v1/ttgo_oled_test.elf term.log
+    ./symbolize.py --map bin/.../TTN_DemoApp.map --svg prof.svg TTN_DemoApp.elf term.log
+"""
+
+import argparse
+import bisect
+import os
+import re
+import shutil
+import subprocess
+import sys
+from collections import Counter, defaultdict
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                '..', 'memreport'))
+import memreport  # noqa: E402
+
+EM_XTENSA = 94
+CROSS_NM = {EM_XTENSA: 'xtensa-esp32-elf-'}
+
+SAMPLE = re.compile(r'([0-9a-fA-F]+) (-?\d+)\s*$')
+THREAD = re.compile(r'PROF thread (-?\d+) (.*?)\s*$')
+BEGIN = re.compile(r'PROF begin (.*?)\s*$')
+
+
+class Profile:
+
+    def __init__(self):
+        self.info = {}
+        self.threads = {}
+        self.samples = []
+
+
+def read_profiles(f):
+    """All PROF blocks of a log, in order."""
+    profiles = []
+    cur = None
+    for line in f:
+        m = BEGIN.search(line)
+        if m:
+            cur = Profile()
+            for kv in m.group(1).split():
+                k, _, v = kv.partition('=')
+                cur.info[k] = v
+            continue
+        if cur is None:
+            continue
+        if 'PROF end' in line:
+            profiles.append(cur)
+            cur = None
+            continue
+        m = THREAD.search(line)
+        if m:
+            cur.threads[int(m.group(1))] = m.group(2)
+            continue
+        m = SAMPLE.search(line)
+        if m:
+            cur.samples.append((int(m.group(1), 16), int(m.group(2))))
+    return profiles
+
+
+def elf_machine(path):
+    with open(path, 'rb') as f:
+        head = f.read(20)
+    if head[:4] != b'\x7fELF':
+        raise ValueError("%s: not an ELF file" % path)
+    order = 'little' if head[5] == 1 else 'big'
+    return int.from_bytes(head[18:20], order)
+
+
+def tool(name, elf, override):
+    if override:
+        return override
+    prefix = os.environ.get('PREFIX') or CROSS_NM.get(elf_machine(elf), '')
+    if prefix and shutil.which(prefix + name):
+        return prefix + name
+    return name
+
+
+class Symbols:
+
+    def __init__(self, elf, nm):
+        out = subprocess.run([nm, '-n', '-S', '--defined-only', elf],
+                             stdout=subprocess.PIPE, check=True,
+                             universal_newlines=True).stdout
+        syms = []
+        for line in out.splitlines():
+            parts = line.split()
+            if len(parts) == 4:
+                addr, size, kind, name = parts
+                size = int(size, 16)
+            elif len(parts) == 3:
+                addr, kind, name = parts
+                size = None
+            else:
+                continue
+            if kind not in 'tTwW':
+                continue
+            syms.append((int(addr, 16), size, name))
+        syms.sort()
+        self.addrs = [s[0] for s in syms]
+        self.syms = syms
+        self.by_name = {s[2]: s[0] for s in syms}
+
+    def lookup(self, pc):
+        i = bisect.bisect_right(self.addrs, pc) - 1
+        if i < 0:
+            return None
+        addr, size, name = self.syms[i]
+        if size is not None and pc >= addr + max(size, 1):
+            return None
+        return name
+
+
+class Modules:
+    """Module (archive) of an address, from the linker map."""
+
+    def __init__(self, path, groups):
+        ranges = []
+        for out, _, addr, size, src in memreport.parse_map(path):
+            if size and memreport.classify(out) in ('text', 'iram'):
+                module = memreport.group_of(memreport.owner(src)[0], groups)
+                ranges.append((addr, addr + size, module))
+        ranges.sort()
+        self.starts = [r[0] for r in ranges]
+        self.ranges = ranges
+
+    def lookup(self, pc):
+        i = bisect.bisect_right(self.starts, pc) - 1
+        if i >= 0 and pc < self.ranges[i][1]:
+            return self.ranges[i][2]
+        return None
+
+
+def folded(profile, syms, modules, offset):
+    stacks = Counter()
+    for pc, pid in profile.samples:
+        pc -= offset
+        func = syms.lookup(pc) or '0x%x' % pc
+        thread = profile.threads.get(pid, 'pid %d' % pid)
+        frames = [thread]
+        if modules:
+            frames.append(modules.lookup(pc) or '?')
+        frames.append(func)
+        stacks[tuple(frames)] += 1
+    return stacks
+
+
+def print_flat(profile, stacks, top, by_thread):
+    total = sum(stacks.values())
+    info = profile.info
+    print("%d samples, period %s us, %s us sampled" %
+          (total, info.get('period_us', '?'), info.get('elapsed_us', '?')))
+
+    def table(counter, n):
+        cum = 0
+        print("%8s %6s %6s  %s" % ('samples', '%', 'cum%', 'function'))
+        for key, count in counter.most_common(n or None):
+            cum += count
+            print("%8d %5.1f%% %5.1f%%  %s" % (count, 100.0 * count / total,
+                                               100.0 * cum / total, key))
+
+    funcs = Counter()
+    threads = Counter()
+    mods = Counter()
+    per_thread = defaultdict(Counter)
+    for frames, count in stacks.items():
+        name = frames[-1]
+        if len(frames) == 3:
+            name = "%s [%s]" % (frames[2], frames[1])
+            mods[frames[1]] += count
+        funcs[name] += count
+        threads[frames[0]] += count
+        per_thread[frames[0]][name] += count
+
+    print()
+    table(funcs, top)
+    if mods:
+        print()
+        print("modules:")
+        for mod, count in mods.most_common():
+            print("%8d %5.1f%%  %s" % (count, 100.0 * count / total, mod))
+    print()
+    print("threads:")
+    for thread, count in threads.most_common():
+        print("%8d %5.1f%%  %s" % (count, 100.0 * count / total, thread))
+    if by_thread:
+        for thread, counter in sorted(per_thread.items()):
+            print()
+            print("thread %s:" % thread)
+            table(counter, top)
+
+
+def write_svg(stacks, path, title):
+    # build the tree: node = [count, children]
+    root = [0, {}]
+    for frames, count in stacks.items():
+        root[0] += count
+        node = root
+        for f in frames:
+            node = node[1].setdefault(f, [0, {}])
+            node[0] += count
+
+    width, row, pad = 1200.0, 18, 10
+    total = max(root[0], 1)
+    depth = max(len(f) for f in stacks) if stacks else 0
+    height = (depth + 1) * row + 3 * pad + 16
+    rects = []
+
+    def walk(node, name, x, level):
+        w = (width - 2 * pad) * node[0] / total
+        if w < 0.5:
+            return
+        y = height - pad - (level + 1) * row
+        h = sum(ord(c) for c in name) % 60
+        color = "rgb(%d,%d,%d)" % (205 + h % 50, 80 + h * 2, 40 + h % 40)
+        label = name if len(name) * 7 < w else name[:max(0, int(w / 7) - 2)]
+        if label != name and label:
+            label += '..'
+        esc = (name.replace('&', '&amp;').replace('<', '&lt;')
+               .replace('>', '&gt;'))
+        lesc = (label.replace('&', '&amp;').replace('<', '&lt;')
+                .replace('>', '&gt;'))
+        rects.append('<g><title>%s (%d samples, %.1f%%)</title>'
+                     '<rect x="%.1f" y="%d" width="%.1f" height="%d" '
+                     'fill="%s" rx="2"/><text x="%.1f" y="%d">%s</text></g>' %
+                     (esc, node[0], 100.0 * node[0] / total, x, y, w,
+                      row - 1, color, x + 3, y + row - 5, lesc))
+        for child_name, child in sorted(node[1].items()):
+            walk(child, child_name, x, level + 1)
+            x += (width - 2 * pad) * child[0] / total
+
+    walk(root, 'all', pad, 0)
+    with open(path, 'w') as f:
+        f.write('<?xml version="1.0" standalone="no"?>\n'
+                '<svg version="1.1" width="%d" height="%d" '
+                'xmlns="http://www.w3.org/2000/svg" '
+                'font-family="monospace" font-size="11">\n'
+                '<rect width="100%%" height="100%%" fill="#f8f8f0"/>\n'
+                '<text x="%d" y="%d" font-size="14">%s</text>\n' %
+                (width, height, pad, pad + 12, title))
+        f.write('\n'.join(rects))
+        f.write('\n</svg>\n')
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                        formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('elf', help="application ELF file")
+    parser.add_argument('log', nargs='?', help="terminal log (default stdin)")
+    parser.add_argument('--map', help="linker map, adds the module of each "
+                                      "function (see make memreport)")
+    parser.add_argument('--riotbase', default=os.environ.get('RIOTBASE'),
+                        help="RIOT tree, to group the archives of packages")
+    parser.add_argument('--group', action='append', default=['shell'],
+                        help="group the modules NAME and NAME_* (repeat)")
+    parser.add_argument('--nm', help="nm to use (default from the ELF "
+                                     "machine, or $PREFIX)")
+    parser.add_argument('--index', type=int, default=-1,
+                        help="which PROF block of the log (default last)")
+    parser.add_argument('--top', type=int, default=30)
+    parser.add_argument('--by-thread', action='store_true',
+                        help="flat profile of every thread")
+    parser.add_argument('--folded', action='store_true',
+                        help="print folded stacks instead")
+    parser.add_argument('--svg', metavar='FILE', help="write a flame graph")
+    args = parser.parse_args()
+
+    if args.log:
+        with open(args.log, errors='replace') as f:
+            profiles = read_profiles(f)
+    else:
+        profiles = read_profiles(sys.stdin)
+    if not profiles:
+        print("symbolize: no PROF block in the log", file=sys.stderr)
+        return 1
+    profile = profiles[args.index]
+
+    syms = Symbols(args.elf, tool('nm', args.elf, args.nm))
+    # relocation of a position independent (native) build
+    offset = 0
+    base = profile.info.get('base')
+    if base and 'profiler_dump' in syms.by_name:
+        offset = int(base, 16) - syms.by_name['profiler_dump']
+
+    modules = None
+    if args.map:
+        groups = list(args.group)
+        if args.riotbase:
+            groups += memreport.package_names(args.riotbase)
+        groups.sort(key=len, reverse=True)
+        modules = Modules(args.map, groups)
+
+    stacks = folded(profile, syms, modules, offset)
+    if args.folded:
+        for frames, count in sorted(stacks.items()):
+            print("%s %d" % (';'.join(frames), count))
+    else:
+        print_flat(profile, stacks, args.top, args.by_thread)
+    if args.svg:
+        write_svg(stacks, args.svg, "%s, %d samples" %
+                  (os.path.basename(args.elf), sum(stacks.values())))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+
+# Copyright (C) 2018 fcgdam
+#
+# This file is subject to the terms and conditions of the GNU Lesser
+# General Public License v2.1. See the file LICENSE in the top level
+# directory for more details.
+
+"""Throughput and latency benchmark of the uart_rpc endpoint.
+
+Checks the ping size limit first, then sends COUNT requests keeping up to
+WINDOW of them in flight and reports operations per second and the request
+latency distribution.
+
+    ./bench.py /dev/ttyUSB0 --count 2000 --window 8 --cmd ping --size 16
+"""
+
+import argparse
+import sys
+import time
+
+import uart_rpc
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+def check_ping(rpc):
+    """The echo has to fit next to the status byte: PAYLOAD_MAX - 1 bytes
+    come back unchanged, PAYLOAD_MAX bytes are refused with an error status
+    and the endpoint keeps answering."""
+    payload = bytes(range(uart_rpc.PAYLOAD_MAX))
+    status, data = rpc.ping(payload[:-1])
+    if status != 0 or data != payload[:-1]:
+        return "%d byte ping: status %d, %d bytes" % (len(payload) - 1,
+                                                      status, len(data))
+    status, data = rpc.ping(payload)
+    if status == 0:
+        return "%d byte ping not refused" % len(payload)
+    status, data = rpc.ping(b'alive')
+    if status != 0 or data != b'alive':
+        return "no answer after %d byte ping" % len(payload)
+    return None
+
+
+def run(rpc, cmd, payload, count, window):
+    sent = {}
+    latencies = []
+    errors = 0
+    inflight = []
+    start = time.monotonic()
+
+    for _ in range(count):
+        if len(inflight) >= window:
+            seq = inflight.pop(0)
+            status, _ = rpc.collect(seq)
+            latencies.append(time.monotonic() - sent.pop(seq))
+            errors += status != 0
+        seq = rpc.submit(cmd, payload)
+        sent[seq] = time.monotonic()
+        inflight.append(seq)
+    for seq in inflight:
+        status, _ = rpc.collect(seq)
+        latencies.append(time.monotonic() - sent.pop(seq))
+        errors += status != 0
+
+    elapsed = time.monotonic() - start
+    return elapsed, latencies, errors
+
+
+def main():
+    cmds = {
+        'ping': (uart_rpc.CMD_PING, None),
+        'led': (uart_rpc.CMD_LED, b'\x01'),
+        'oled': (uart_rpc.CMD_OLED_TEXT, b'\x00\x0cbench'),
+    }
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('port')
+    parser.add_argument('--baudrate', type=int, default=115200)
+    parser.add_argument('--count', type=int, default=1000)
+    parser.add_argument('--window', type=int, default=8,
+                        help="requests in flight, 1 disables pipelining")
+    parser.add_argument('--cmd', choices=sorted(cmds), default='ping')
+    parser.add_argument('--size', type=int, default=16,
+                        help="ping payload size")
+    args = parser.parse_args()
+
+    cmd, payload = cmds[args.cmd]
+    if payload is None:
+        payload = bytes(range(args.size))
+
+    rpc = uart_rpc.UartRpc(args.port, args.baudrate)
+    error = check_ping(rpc)
+    if error:
+        print("ping check failed:", error)
+        rpc.close()
+        return 1
+    elapsed, lat, errors = run(rpc, cmd, payload, args.count, args.window)
+
+    print("%d x %s, window %d, %d errors" %
+          (args.count, args.cmd, args.window, errors))
+    print("throughput: %.1f ops/s" % (args.count / elapsed))
+    print("latency ms: min %.2f  p50 %.2f  p99 %.2f  max %.2f" %
+          (min(lat) * 1e3, percentile(lat, 50) * 1e3,
+           percentile(lat, 99) * 1e3, max(lat) * 1e3))
+    print("device:", rpc.stats())
+    rpc.close()
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
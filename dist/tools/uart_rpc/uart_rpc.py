@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+
+# Copyright (C) 2018 fcgdam
+#
+# This file is subject to the terms and conditions of the GNU Lesser
+# General Public License v2.1. See the file LICENSE in the top level
+# directory for more details.
+
+"""Host client for the uart_rpc module.
+
+Frames (see modules/uart_rpc/include/uart_rpc.h):
+
+    | 0xA5 | seq | cmd | len | payload | crc16 LSB first |
+
+Requests can be pipelined: submit() only writes the frame, collect() reads
+responses until the one with the wanted seq arrived. Anything that is not a
+valid frame (e.g. text printed by the firmware) is skipped.
+
+    rpc = UartRpc('/dev/ttyUSB0')
+    status, data = rpc.call(CMD_PING, b'hello')
+"""
+
+import struct
+import time
+
+SOF = 0xA5
+RESPONSE = 0x80
+PAYLOAD_MAX = 64
+
+CMD_PING = 0x00
+CMD_STATS = 0x01
+CMD_LIST = 0x02
+
+# Application commands of the examples
+CMD_LED = 0x10
+CMD_OLED_INIT = 0x20
+CMD_OLED_TEXT = 0x21
+CMD_LORA_SEND = 0x30
+
+# RPC_SEND_TIMEOUT of the TTN example, in s
+LORA_SEND_TIMEOUT = 10.0
+
+
+class RpcError(Exception):
+    pass
+
+
+def crc16(data, crc=0xFFFF):
+    """CRC-16/CCITT-FALSE."""
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def encode(seq, cmd, payload=b''):
+    if len(payload) > PAYLOAD_MAX:
+        raise ValueError("payload too long")
+    body = bytes([seq & 0xFF, cmd, len(payload)]) + bytes(payload)
+    return bytes([SOF]) + body + struct.pack('<H', crc16(body))
+
+
+class Decoder:
+    """Incremental frame decoder, returns (seq, cmd, payload) tuples."""
+
+    def __init__(self):
+        self.buf = bytearray()
+        self.crc_errors = 0
+
+    def feed(self, data):
+        self.buf += data
+        frames = []
+        while True:
+            start = self.buf.find(SOF)
+            if start < 0:
+                self.buf.clear()
+                break
+            del self.buf[:start]
+            if len(self.buf) < 4:
+                break
+            length = self.buf[3]
+            end = 4 + length + 2
+            if length > PAYLOAD_MAX:
+                del self.buf[0]
+                continue
+            if len(self.buf) < end:
+                break
+            body = bytes(self.buf[1:4 + length])
+            crc, = struct.unpack('<H', self.buf[4 + length:end])
+            if crc != crc16(body):
+                # not a frame or a corrupted one, resync after the SOF
+                self.crc_errors += 1
+                del self.buf[0]
+                continue
+            frames.append((body[0], body[1], body[3:]))
+            del self.buf[:end]
+        return frames
+
+
+class UartRpc:
+
+    def __init__(self, port, baudrate=115200, timeout=1.0, transport=None):
+        if transport is None:
+            import serial
+            transport = serial.Serial(port, baudrate, timeout=0.01)
+        self.io = transport
+        self.timeout = timeout
+        self.seq = 0
+        self.decoder = Decoder()
+        self.pending = {}
+
+    def close(self):
+        self.io.close()
+
+    def submit(self, cmd, payload=b''):
+        """Send a request without waiting, returns its seq."""
+        seq = self.seq
+        self.seq = (self.seq + 1) & 0xFF
+        self.io.write(encode(seq, cmd, payload))
+        return seq
+
+    def collect(self, seq, timeout=None):
+        """Wait for the response to seq, returns (status, data)."""
+        deadline = time.monotonic() + (timeout or self.timeout)
+        while seq not in self.pending:
+            if time.monotonic() > deadline:
+                raise RpcError("timeout waiting for seq %d" % seq)
+            data = self.io.read(256)
+            for rseq, cmd, payload in self.decoder.feed(data):
+                if cmd & RESPONSE and payload:
+                    self.pending[rseq] = payload
+        payload = self.pending.pop(seq)
+        return struct.unpack('b', payload[:1])[0], bytes(payload[1:])
+
+    def call(self, cmd, payload=b''):
+        return self.collect(self.submit(cmd, payload))
+
+    # convenience wrappers
+
+    def ping(self, payload=b''):
+        return self.call(CMD_PING, payload)
+
+    def stats(self):
+        status, data = self.call(CMD_STATS)
+        keys = ('requests', 'crc_errors', 'unknown', 'overruns')
+        return dict(zip(keys, struct.unpack('<4I', data[:16])))
+
+    def commands(self):
+        status, data = self.call(CMD_LIST)
+        cmds = {}
+        while data:
+            end = data.index(0, 1)
+            cmds[data[0]] = data[1:end].decode()
+            data = data[end + 1:]
+        return cmds
+
+    def led(self, on):
+        return self.call(CMD_LED, bytes([1 if on else 0]))[0]
+
+    def oled_init(self):
+        return self.call(CMD_OLED_INIT)[0]
+
+    def oled_text(self, text, x=0, y=12):
+        return self.call(CMD_OLED_TEXT, bytes([x, y]) + text.encode())[0]
+
+    def lora_send(self, payload):
+        # the firmware answers within LORA_SEND_TIMEOUT, with -ETIMEDOUT
+        # if the MAC was busy
+        seq = self.submit(CMD_LORA_SEND, bytes(payload))
+        return self.collect(seq, LORA_SEND_TIMEOUT + 2.0)[0]
@@ -1,5 +1,6 @@
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "thread.h"
@@ -8,6 +9,25 @@
 #include "xtimer.h"
 #include "led.h"
 #include "periph/gpio.h"
+#include "arduino_fastio.h"
+
+#ifdef MODULE_UART_RPC
+#include <errno.h>
+#include "uart_rpc.h"
+#endif
+
+#ifdef MODULE_GPIO_EVENT
+#include "gpio_event.h"
+#include "gpio_event_params.h"
+#endif
+
+#ifdef MODULE_EVLOOP
+#include "evloop.h"
+#endif
+
+#ifdef MODULE_STACK_USAGE
+#include "stack_usage.h"
+#endif
 
 #ifdef MODULE_NETIF
 #include "net/gnrc/pktdump.h"
@@ -35,11 +55,171 @@ static int led_cmd(int argc, char **argv) {
     return 1;
 }
 
+#ifdef MODULE_EVLOOP
+// Events of the "ui" loop, later features add events here instead of
+// threads. The handlers only touch the led, a small stack is enough.
+#ifndef UI_STACKSIZE
+#define UI_STACKSIZE    (THREAD_STACKSIZE_SMALL)
+#endif
+
+static char ui_stack[UI_STACKSIZE];
+static evloop_t ui_loop;
+static evloop_event_t ev_init;
+
+static int events_cmd(int argc, char **argv) {
+    if ( argc == 2 && strcmp( argv[1] , "reset" ) == 0 ) {
+        evloop_stats_reset();
+        return 0;
+    }
+    if ( argc != 1 ) {
+        (void) puts("Usage: events [reset]");
+        return 1;
+    }
+
+    evloop_print_stats();
+    return 0;
+}
+#endif
+
+#ifdef MODULE_GPIO_EVENT
+// The BOOT button toggles the led through the GPIO event dispatcher
+static evloop_event_t ev_button;
+static gpio_event_sub_t button_sub;
+
+static void button_handler(evloop_event_t *ev) {
+    (void) ev;
+    gpio_event_t edge;
+
+    while ( gpio_event_get( &button_sub, &edge ) ) {
+        LED_TOGGLE(0);
+    }
+}
+
+static int gpioev_cmd(int argc, char **argv) {
+    if ( argc == 2 && strcmp( argv[1] , "reset" ) == 0 ) {
+        gpio_event_stats_reset();
+        return 0;
+    }
+    if ( argc != 1 ) {
+        (void) puts("Usage: gpioev [reset]");
+        return 1;
+    }
+
+    gpio_event_print_stats();
+    return 0;
+}
+#endif
+
+// Toggle rate of the led pin: generic gpio_set/gpio_clear against the
+// compile time resolved register writes of arduino_fastio.h
+#define TOGGLE_DEFAULT_LOOPS    (100000U)
+
+static int toggle_cmd(int argc, char **argv) {
+    unsigned loops = TOGGLE_DEFAULT_LOOPS;
+    if ( argc == 2 ) {
+        loops = (unsigned) atoi( argv[1] );
+    }
+    if ( argc > 2 || loops == 0 ) {
+        (void) puts("Usage: toggle [loops]");
+        return 1;
+    }
+
+    uint32_t start = xtimer_now_usec();
+    for ( unsigned i = 0; i < loops; i++ ) {
+        gpio_set( LED0_PIN );
+        gpio_clear( LED0_PIN );
+    }
+    uint32_t t_gpio = xtimer_now_usec() - start;
+
+    start = xtimer_now_usec();
+    for ( unsigned i = 0; i < loops; i++ ) {
+        arduino_fastio_gpio_write( LED0_PIN, 1 );
+        arduino_fastio_gpio_write( LED0_PIN, 0 );
+    }
+    uint32_t t_fast = xtimer_now_usec() - start;
+
+    // Pin 4 is the Arduino pin of the led (GPIO2)
+    start = xtimer_now_usec();
+    for ( unsigned i = 0; i < loops; i++ ) {
+        arduino_fastio_write_mask( ARDUINO_FASTIO_MASK(4), 0 );
+        arduino_fastio_write_mask( 0, ARDUINO_FASTIO_MASK(4) );
+    }
+    uint32_t t_mask = xtimer_now_usec() - start;
+
+    printf("%u toggles\n", loops);
+    printf("gpio_set/clear: %8lu us, %6lu kHz\n", (unsigned long) t_gpio,
+           (unsigned long) (t_gpio ? (loops * 1000ULL) / t_gpio : 0));
+    printf("fastio write  : %8lu us, %6lu kHz\n", (unsigned long) t_fast,
+           (unsigned long) (t_fast ? (loops * 1000ULL) / t_fast : 0));
+    printf("fastio mask   : %8lu us, %6lu kHz\n", (unsigned long) t_mask,
+           (unsigned long) (t_mask ? (loops * 1000ULL) / t_mask : 0));
+    return 0;
+}
+
+#ifdef MODULE_EVLOOP
+static void init_handler(evloop_event_t *ev) {
+    (void) ev;
+
+#ifdef MODULE_GPIO_EVENT
+    // gpio_event wakes up the subscribing thread
+    gpio_event_subscribe( &button_sub, 1UL << GPIO_EVENT_LINE_BUTTON0 );
+#endif
+}
+#endif
+
+#ifdef MODULE_STACK_USAGE
+static int stack_cmd(int argc, char **argv) {
+    if ( argc == 2 && strcmp( argv[1] , "reset" ) == 0 ) {
+        stack_usage_repaint();
+        return 0;
+    }
+    if ( argc != 1 ) {
+        (void) puts("Usage: stack [reset]");
+        return 1;
+    }
+
+    stack_usage_print();
+    return 0;
+}
+#endif
+
 const shell_command_t shell_commands[] = {
     {"led", "Turns on the onboard led.", led_cmd },
+    {"toggle", "Led toggle rate, gpio_set against fast GPIO.", toggle_cmd },
+#ifdef MODULE_GPIO_EVENT
+    {"gpioev", "GPIO event statistics and IRQ latency histograms.", gpioev_cmd },
+#endif
+#ifdef MODULE_EVLOOP
+    {"events", "Event loop dispatch statistics.", events_cmd },
+#endif
+#ifdef MODULE_STACK_USAGE
+    {"stack", "Thread stack high-water marks.", stack_cmd },
+#endif
     {NULL, NULL, NULL}
 };
 
+#ifdef MODULE_UART_RPC
+// RPC led command: one payload byte, 0 = off, 1 = on
+static int led_rpc(const uint8_t *req, size_t req_len, uint8_t *resp, size_t *resp_len) {
+    (void) resp;
+    (void) resp_len;
+    if ( req_len != 1 ) {
+        return -EINVAL;
+    }
+    if ( req[0] ) {
+        LED_ON(0);
+    } else {
+        LED_OFF(0);
+    }
+    return 0;
+}
+
+static const uart_rpc_command_t rpc_commands[] = {
+    { 0x10, "led", led_rpc },
+    { 0, NULL, NULL }
+};
+#endif
+
 
 int main(void)
 {
@@ -49,8 +229,26 @@ int main(void)
     gpio_init( pinled , GPIO_OUT);
     gpio_set( pinled );
 
+#ifdef MODULE_EVLOOP
+    evloop_event_init( &ui_loop, &ev_init, "init", init_handler );
+#ifdef MODULE_GPIO_EVENT
+    evloop_event_init( &ui_loop, &ev_button, "button", button_handler );
+    evloop_bind_flag( &ui_loop, GPIO_EVENT_THREAD_FLAG, &ev_button );
+    if ( gpio_event_init() < 0 ) {
+        (void) puts("GPIO event init failed");
+    }
+#endif
+    evloop_start( &ui_loop, ui_stack, sizeof(ui_stack), THREAD_PRIORITY_MAIN - 2,
+                  "ui" );
+    evloop_post( &ev_init );
+#endif
+
+#ifdef MODULE_UART_RPC
+    uart_rpc_run( rpc_commands );
+#else
     char line_buf[SHELL_DEFAULT_BUFSIZE];
     shell_run( shell_commands, line_buf, SHELL_DEFAULT_BUFSIZE);
+#endif
 
     return 0;
 }
@@ -12,6 +12,21 @@
 #include "periph/i2c.h"
 #include "u8g2.h"
 
+#include "evloop.h"
+
+#ifdef MODULE_UART_RPC
+#include <errno.h>
+#include "uart_rpc.h"
+#endif
+
+#ifdef MODULE_STACK_USAGE
+#include "stack_usage.h"
+#endif
+
+#ifdef MODULE_PROFILER
+#include "profiler.h"
+#endif
+
 /**
  * @brief   RIOT-OS pin maping of U8g2 pin numbers to RIOT-OS GPIO pins.
  * @note    To minimize the overhead, you can implement an alternative for
@@ -62,6 +77,24 @@ static const uint8_t logo[] = {
 
 uint32_t screen = 0;
 
+/*
+ * The display belongs to the "display" event loop: init, the test screens
+ * and the RPC text are its events, so the shell stays responsive while the
+ * screens change and u8g2 is only ever called from one thread. Drawing
+ * goes through u8g2 and the I2C driver, the stack is the default one.
+ */
+#ifndef DISPLAY_STACKSIZE
+#define DISPLAY_STACKSIZE   (THREAD_STACKSIZE_DEFAULT)
+#endif
+
+#define TEST_FRAMES         (15U)
+
+static char display_stack[DISPLAY_STACKSIZE];
+static evloop_t display_loop;
+static evloop_event_t ev_init;
+static evloop_event_t ev_refresh;
+static volatile unsigned frames_left;
+
 void OLed_Init(void) {
     puts("Initializing OLED");
 
@@ -81,39 +114,48 @@ void OLed_Init(void) {
     puts("OLED initialized");
 }
 
+static void init_handler(evloop_event_t *ev) {
+    (void) ev;
+    OLed_Init();
+}
+
+/* One screen of the test, the next one a second later */
+static void refresh_handler(evloop_event_t *ev) {
+    u8g2_FirstPage(&u8g2);
+
+    do {
+        u8g2_SetDrawColor(&u8g2, 1);
+        u8g2_SetFont(&u8g2, u8g2_font_helvB12_tf);
+
+        switch (screen) {
+            case 0:
+                u8g2_DrawStr(&u8g2, 12, 22, "THIS");
+                break;
+            case 1:
+                u8g2_DrawStr(&u8g2, 24, 22, "IS");
+                break;
+            case 2:
+                u8g2_DrawBitmap(&u8g2, 0, 0, 8, 32, logo);
+                break;
+        }
+    }
+    while (u8g2_NextPage(&u8g2));
+
+    /* show screen in next iteration */
+    screen = (screen + 1) % 3;
+
+    if (frames_left && --frames_left) {
+        evloop_post_in(ev, US_PER_SEC);
+    }
+}
+
+/* Cycles the test screens for 15 s, returns right away */
 void OLed_Test(void) {
-    int loop = 15;
-    while (loop--) {
-        puts("Drawing...");
-        u8g2_FirstPage(&u8g2);
-
-        do {
-            u8g2_SetDrawColor(&u8g2, 1);
-            u8g2_SetFont(&u8g2, u8g2_font_helvB12_tf);
-
-            switch (screen) {
-                case 0:
-                    u8g2_DrawStr(&u8g2, 12, 22, "THIS");
-                    break;
-                case 1:
-                    u8g2_DrawStr(&u8g2, 24, 22, "IS");
-                    break;
-                case 2:
-                    u8g2_DrawBitmap(&u8g2, 0, 0, 8, 32, logo);
-                    break;
-            }
-        } 
-        while (u8g2_NextPage(&u8g2));
-
-        /* show screen in next iteration */
-        screen = (screen + 1) % 3;
-
-        /* sleep a little */
-        puts("Sleeping...");
-        xtimer_sleep(1);
-    }  
+    frames_left = TEST_FRAMES;
+    evloop_post(&ev_refresh);
 }
 
+#ifndef MODULE_UART_RPC
 static void oled_cmd_usage(void) {
     puts("Usage: oled init | test ");
 }
@@ -126,7 +168,7 @@ static int oled_cmd(int argc, char **argv)
     }
     
     if ( strcmp(argv[1],"init") == 0 )
-        OLed_Init();
+        evloop_post(&ev_init);
 
     if ( strcmp(argv[1],"test") == 0 )
         OLed_Test();
@@ -139,11 +181,104 @@ static int draw_cmd(int argc, char **argv) {
     return 0;
 }
 
+static int events_cmd(int argc, char **argv) {
+    if ( argc == 2 && strcmp( argv[1] , "reset" ) == 0 ) {
+        evloop_stats_reset();
+        return 0;
+    }
+    if ( argc != 1 ) {
+        puts("Usage: events [reset]");
+        return 1;
+    }
+
+    evloop_print_stats();
+    return 0;
+}
+
+#ifdef MODULE_STACK_USAGE
+static int stack_cmd(int argc, char **argv) {
+    if ( argc == 2 && strcmp( argv[1] , "reset" ) == 0 ) {
+        stack_usage_repaint();
+        return 0;
+    }
+    if ( argc != 1 ) {
+        puts("Usage: stack [reset]");
+        return 1;
+    }
+
+    stack_usage_print();
+    return 0;
+}
+#endif
+
 static const shell_command_t shell_commands[] = {
     {"oled" , "Oled commands" , oled_cmd },
     {"test" , "Test output on the oled" , draw_cmd },
+    {"events" , "Display event loop statistics" , events_cmd },
+#ifdef MODULE_STACK_USAGE
+    {"stack" , "Thread stack high-water marks" , stack_cmd },
+#endif
+#ifdef MODULE_PROFILER
+    {"prof" , "Sampling profiler: start [hz], stop, dump" , profiler_cmd },
+#endif
     { NULL , NULL , NULL}
 };
+#endif
+
+#ifdef MODULE_UART_RPC
+static evloop_event_t ev_text;
+static uint8_t text_x, text_y;
+static char text[UART_RPC_PAYLOAD_MAX];
+static volatile uint8_t text_busy;
+
+static void text_handler(evloop_event_t *ev) {
+    (void) ev;
+
+    u8g2_FirstPage(&u8g2);
+    do {
+        u8g2_SetDrawColor(&u8g2, 1);
+        u8g2_SetFont(&u8g2, u8g2_font_helvB12_tf);
+        u8g2_DrawStr(&u8g2, text_x, text_y, text);
+    } while (u8g2_NextPage(&u8g2));
+    text_busy = 0;
+}
+
+static int oled_init_rpc(const uint8_t *req, size_t req_len, uint8_t *resp, size_t *resp_len) {
+    (void) req;
+    (void) req_len;
+    (void) resp;
+    (void) resp_len;
+    evloop_post(&ev_init);
+    return 0;
+}
+
+/* Payload: x, y, text (not terminated). Drawn by the display loop, busy
+ * until the previous text is on the screen. */
+static int oled_text_rpc(const uint8_t *req, size_t req_len, uint8_t *resp, size_t *resp_len) {
+    (void) resp;
+    (void) resp_len;
+    if ( req_len < 3 ) {
+        return -EINVAL;
+    }
+    if ( text_busy ) {
+        return -EBUSY;
+    }
+    text_busy = 1;
+    text_x = req[0];
+    text_y = req[1];
+    memcpy(text, &req[2], req_len - 2);
+    text[req_len - 2] = '\0';
+    evloop_post(&ev_text);
+
+    return 0;
+}
+
+static const uart_rpc_command_t rpc_commands[] = {
+    { 0x20, "oled_init", oled_init_rpc },
+    { 0x21, "oled_text", oled_text_rpc },
+    { 0, NULL, NULL }
+};
+#endif
 
 int main(void)
 {
@@ -152,7 +287,14 @@ int main(void)
     puts("Welcome to RIOT!");
 
     puts ("Initial Oled testing");
-    OLed_Init();
+    evloop_event_init(&display_loop, &ev_init, "init", init_handler);
+    evloop_event_init(&display_loop, &ev_refresh, "refresh", refresh_handler);
+#ifdef MODULE_UART_RPC
+    evloop_event_init(&display_loop, &ev_text, "text", text_handler);
+#endif
+    evloop_start(&display_loop, display_stack, sizeof(display_stack),
+                 THREAD_PRIORITY_MAIN - 1, "display");
+    evloop_post(&ev_init);
     OLed_Test();
     
 /*puts("Reseting OLED:");
@@ -163,8 +305,12 @@ int main(void)
 */
    
 
+#ifdef MODULE_UART_RPC
+    uart_rpc_run(rpc_commands);
+#else
     char line_buf[SHELL_DEFAULT_BUFSIZE];
     shell_run(shell_commands, line_buf, SHELL_DEFAULT_BUFSIZE);
+#endif
 
     return 0;
 }
@@ -26,25 +26,192 @@
 
 #include "msg.h"
 #include "thread.h"
+#include "thread_flags.h"
 #include "fmt.h"
+#include "log.h"
+#include "shell.h"
+#include "xtimer.h"
 
 #include "periph/rtc.h"
 
 #include "net/loramac.h"
 #include "semtech_loramac.h"
 
+#include "evloop.h"
+
+#ifdef MODULE_UART_RPC
+#include <errno.h>
+#include "uart_rpc.h"
+#endif
+
+#ifdef MODULE_LORA_CRYPTO
+#include "lora_crypto.h"
+#endif
+
+#ifdef MODULE_STACK_USAGE
+#include "stack_usage.h"
+#endif
+
+#ifdef MODULE_PROFILER
+#include "profiler.h"
+#endif
+
+#ifdef MODULE_GPIO_EVENT
+#include "gpio_event.h"
+#include "gpio_event_params.h"
+#endif
+
+#ifdef MODULE_RTC_RETAIN
+#include "mutex.h"
+#include "rtc_retain.h"
+#include "LoRaMac.h"
+#endif
+
 /* Messages are sent every 20s to respect the duty cycle on each channel */
 #define PERIOD              (20U)
 
-#define SENDER_PRIO         (THREAD_PRIORITY_MAIN - 1)
-static kernel_pid_t sender_pid;
-static char sender_stack[THREAD_STACKSIZE_MAIN / 2];
+/* Join, uplinks and downlinks are events of one loop thread. It is the only
+   thread calling into the MAC, so the MAC always reports back to it. Check
+   the stack and message queue size with the stack command and override them
+   with CFLAGS, the queue size must be a power of 2. */
+#ifndef LORAWAN_STACKSIZE
+#define LORAWAN_STACKSIZE   (THREAD_STACKSIZE_MAIN / 2)
+#endif
+#ifndef LORAWAN_QUEUE_SIZE
+#define LORAWAN_QUEUE_SIZE  (8U)
+#endif
+
+#define LORAWAN_PRIO        (THREAD_PRIORITY_MAIN - 1)
+static char lorawan_stack[LORAWAN_STACKSIZE];
+static msg_t lorawan_queue[LORAWAN_QUEUE_SIZE];
+
+static evloop_t lorawan_loop;
+static evloop_event_t ev_init;      /* first event, set up in the loop thread */
+static evloop_event_t ev_join;      /* join, retried every 60s */
+static evloop_event_t ev_send;      /* RTC alarm, BOOT button, send command */
+static evloop_event_t ev_radio;     /* messages of the MAC */
+#ifdef MODULE_GPIO_EVENT
+static evloop_event_t ev_button;    /* edges of the BOOT button */
+static gpio_event_sub_t button_sub;
+/* the radio of the package, its DIO interrupts are timed by gpio_event */
+extern sx127x_t sx127x;
+#endif
+
+static uint8_t joined;
+/* woken up from deep sleep with the session of the last cycle */
+static uint8_t warm;
+
+#ifdef MODULE_RTC_RETAIN
+/* Deep sleep between the uplinks right after a cold boot, otherwise only
+   after "sleep on" */
+#ifndef LORAWAN_SLEEP_DEFAULT
+#define LORAWAN_SLEEP_DEFAULT   (0)
+#endif
+
+/* Channels kept over the deep sleep: the ones added by the network (join
+   accept CFList, NewChannelReq) and the channel mask. The US915, AU915 and
+   CN470 channels are fixed, there only the mask changes. */
+#if defined(REGION_US915) || defined(REGION_AU915) || defined(REGION_CN470)
+#define RETAIN_CHANNELS         (0U)
+#define RETAIN_CHANNELS_MASK    (6U)
+#else
+#define RETAIN_CHANNELS         (16U)
+#define RETAIN_CHANNELS_MASK    (1U)
+#endif
+
+/* Duty cycle of the band of the uplinks as 1/x, 1 for none. The three
+   EU868 default channels are in the 1% g1 sub-band: after a frame of t ms
+   on air the band is closed for 99 t ms. The MAC keeps that time-off in
+   RAM, a deep sleep loses it, so the node keeps it in RTC memory and never
+   sleeps shorter. */
+#if defined(REGION_EU868)
+#define DUTY_CYCLE_INV          (100U)
+#else
+#define DUTY_CYCLE_INV          (1U)
+#endif
+
+/* MHDR, FHDR without FOpts, FPort and MIC. The FOpts are counted at their
+   maximum of 15 bytes, the time-off is never too short. */
+#define LORAWAN_FRAME_OVERHEAD  (13U + 15U)
+
+/* the MAC has no MIB for the RX1 data rate offset of RxParamSetupReq */
+extern LoRaMacParams_t LoRaMacParams;
+
+/* State kept in RTC memory over the deep sleep between two uplinks: the
+   LoRaWAN session (an OTAA session is resumed without joining again) with
+   the class and the radio settings the network may have changed, the duty
+   cycle time-off of the last uplink, the crypto backend and the boot to TX
+   times. */
+typedef struct {
+    uint8_t devaddr[LORAMAC_DEVADDR_LEN];
+    uint8_t appskey[LORAMAC_APPSKEY_LEN];
+    uint8_t nwkskey[LORAMAC_NWKSKEY_LEN];
+    uint32_t fcnt_up;
+    uint32_t fcnt_down;
+    uint32_t net_id;
+    uint8_t cls;
+    int8_t datarate;
+    int8_t tx_power;
+    uint8_t adr;
+    uint32_t rx1_delay;
+    uint32_t rx2_delay;
+    uint8_t rx1_dr_offset;
+    uint8_t nb_rep;
+    Rx2ChannelParams_t rx2;
+    uint16_t channels_mask[RETAIN_CHANNELS_MASK];
+#if RETAIN_CHANNELS
+    ChannelParams_t channels[RETAIN_CHANNELS];
+#endif
+    uint32_t airtime_ms;        /* of the last uplink */
+    uint32_t time_off_ms;       /* band closed after it */
+    uint32_t tx_done_rtc;       /* RTC time in s at its end, rounded up */
+    uint8_t crypto;
+    uint8_t sleep;              /* sleep between the uplinks */
+    uint32_t cold_to_tx_us;     /* after the last cold boot, join included */
+    uint32_t warm_count;
+    uint32_t warm_min_us;
+    uint32_t warm_max_us;
+    uint64_t warm_sum_us;
+} retained_t;
+
+static retained_t retained;
+static uint8_t tx_marked;
+#endif
 
 uint8_t nodeactivation = NODEACTIVATION;
 semtech_loramac_t loramac;
 
 static const char *message = "This is RIOT!";
 
+/* Downlinks are messages of the MAC to the loop thread, in Class A they
+   arrive in the RX windows after an uplink, in Class C at any time between
+   uplinks. */
+#ifndef LORAWAN_CLASS
+#define LORAWAN_CLASS       LORAMAC_CLASS_A
+#endif
+
+typedef struct {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+} latency_t;
+
+/* Indexed by class. For every downlink the time from the RxDone interrupt
+   of the radio (DIO0, timestamped by gpio_event) to its handler in the loop
+   thread. In Class A also the time from the end of the last uplink, the
+   downlink is received in RX1 or RX2 after it; a Class C downlink is not
+   tied to an uplink. */
+typedef struct {
+    uint32_t count;
+    latency_t irq_us;
+    latency_t uplink_ms;
+} downlink_stats_t;
+
+static downlink_stats_t downlink_stats[LORAMAC_CLASS_C + 1];
+static loramac_class_t lorawan_class = LORAWAN_CLASS;
+static uint32_t last_tx_done;
+
 /* Information for OTAA activation
 */
 static uint8_t deveui[LORAMAC_DEVEUI_LEN];
@@ -60,8 +227,7 @@ uint8_t nwkskey[LORAMAC_NWKSKEY_LEN];
 static void rtc_cb(void *arg)
 {
     (void) arg;
-    msg_t msg;
-    msg_send(&msg, sender_pid);
+    evloop_post(&ev_send);
 }
 
 static void _prepare_next_alarm(void)
@@ -74,61 +240,645 @@ static void _prepare_next_alarm(void)
     rtc_set_alarm(&time, rtc_cb, NULL);
 }
 
-static void _send_message(void)
+#ifdef MODULE_RTC_RETAIN
+static void _mark_tx(void)
+{
+    /* time since RIOT started, ROM and bootloader are not included */
+    uint32_t now = xtimer_now_usec();
+
+    if (tx_marked) {
+        return;
+    }
+    tx_marked = 1;
+    if (!warm) {
+        retained.cold_to_tx_us = now;
+        return;
+    }
+    if (retained.warm_count == 0 || now < retained.warm_min_us) {
+        retained.warm_min_us = now;
+    }
+    if (now > retained.warm_max_us) {
+        retained.warm_max_us = now;
+    }
+    retained.warm_sum_us += now;
+    retained.warm_count++;
+}
+
+static uint32_t _rtc_seconds(void)
+{
+    struct tm time;
+
+    rtc_get_time(&time);
+    return (uint32_t)mktime(&time);
+}
+
+/* LoRa time on air in ms (SX1276 datasheet 4.1.1.7): 8 symbol preamble,
+   explicit header, CR 4/5, CRC on. EU868 data rates, DR7 (FSK) is counted
+   as SF7/125 kHz, which is longer. */
+static uint32_t _time_on_air_ms(int8_t dr, unsigned len)
+{
+    unsigned sf = (dr >= 0 && dr < 6) ? 12 - dr : 7;
+    unsigned bw_khz = (dr == 6) ? 250 : 125;
+    unsigned de = (sf >= 11 && bw_khz == 125);
+    int num = 8 * (int)len - 4 * (int)sf + 28 + 16;
+    unsigned den = 4 * (sf - 2 * de);
+    unsigned symbols = 8 + ((num > 0) ? ((num + den - 1) / den) * 5 : 0);
+
+    /* (12.25 + symbols) * 2^sf / bw */
+    return (((49U + 4U * symbols) << sf) + 4U * bw_khz - 1) / (4U * bw_khz);
+}
+
+/* Time until the band is free again after the last uplink. An RTC that
+   went back (not kept over the reset) counts as no time passed. */
+static uint32_t _time_off_left_us(void)
+{
+    uint32_t off = (retained.time_off_ms + MS_PER_SEC - 1) / MS_PER_SEC;
+    uint32_t now = _rtc_seconds();
+
+    if (off == 0 || now >= retained.tx_done_rtc + off) {
+        return 0;
+    }
+    if (now < retained.tx_done_rtc) {
+        return off * US_PER_SEC;
+    }
+    return (retained.tx_done_rtc + off - now) * US_PER_SEC;
+}
+
+static void _mib_get(MibRequestConfirm_t *mib, Mib_t type)
+{
+    mib->Type = type;
+    mutex_lock(&loramac.lock);
+    LoRaMacMibGetRequestConfirm(mib);
+    mutex_unlock(&loramac.lock);
+}
+
+static void _mib_set(MibRequestConfirm_t *mib, Mib_t type)
+{
+    mib->Type = type;
+    mutex_lock(&loramac.lock);
+    LoRaMacMibSetRequestConfirm(mib);
+    mutex_unlock(&loramac.lock);
+}
+
+static void _save_session(void)
+{
+    MibRequestConfirm_t mib;
+
+    semtech_loramac_get_devaddr(&loramac, retained.devaddr);
+    semtech_loramac_get_appskey(&loramac, retained.appskey);
+    semtech_loramac_get_nwkskey(&loramac, retained.nwkskey);
+    _mib_get(&mib, MIB_UPLINK_COUNTER);
+    retained.fcnt_up = mib.Param.UpLinkCounter;
+    _mib_get(&mib, MIB_DOWNLINK_COUNTER);
+    retained.fcnt_down = mib.Param.DownLinkCounter;
+    _mib_get(&mib, MIB_NET_ID);
+    retained.net_id = mib.Param.NetID;
+    retained.cls = lorawan_class;
+
+    /* settings the network may have changed with MAC commands */
+    _mib_get(&mib, MIB_CHANNELS_DATARATE);
+    retained.datarate = mib.Param.ChannelsDatarate;
+    _mib_get(&mib, MIB_CHANNELS_TX_POWER);
+    retained.tx_power = mib.Param.ChannelsTxPower;
+    _mib_get(&mib, MIB_ADR);
+    retained.adr = mib.Param.AdrEnable;
+    _mib_get(&mib, MIB_RECEIVE_DELAY_1);
+    retained.rx1_delay = mib.Param.ReceiveDelay1;
+    _mib_get(&mib, MIB_RECEIVE_DELAY_2);
+    retained.rx2_delay = mib.Param.ReceiveDelay2;
+    _mib_get(&mib, MIB_CHANNELS_NB_REP);
+    retained.nb_rep = mib.Param.ChannelNbRep;
+    mutex_lock(&loramac.lock);
+    retained.rx1_dr_offset = LoRaMacParams.Rx1DrOffset;
+    mutex_unlock(&loramac.lock);
+    _mib_get(&mib, MIB_RX2_CHANNEL);
+    retained.rx2 = mib.Param.Rx2Channel;
+    _mib_get(&mib, MIB_CHANNELS_MASK);
+    memcpy(retained.channels_mask, mib.Param.ChannelsMask,
+           sizeof(retained.channels_mask));
+#if RETAIN_CHANNELS
+    _mib_get(&mib, MIB_CHANNELS);
+    memcpy(retained.channels, mib.Param.ChannelList, sizeof(retained.channels));
+#endif
+}
+
+/* Activate the retained session as ABP, the frame counters go on */
+static void _resume(void)
+{
+    MibRequestConfirm_t mib;
+
+    semtech_loramac_set_devaddr(&loramac, retained.devaddr);
+    semtech_loramac_set_appskey(&loramac, retained.appskey);
+    semtech_loramac_set_nwkskey(&loramac, retained.nwkskey);
+    semtech_loramac_join(&loramac, LORAMAC_JOIN_ABP);
+    mib.Param.UpLinkCounter = retained.fcnt_up;
+    _mib_set(&mib, MIB_UPLINK_COUNTER);
+    mib.Param.DownLinkCounter = retained.fcnt_down;
+    _mib_set(&mib, MIB_DOWNLINK_COUNTER);
+    /* the ABP join sets the default */
+    mib.Param.NetID = retained.net_id;
+    _mib_set(&mib, MIB_NET_ID);
+
+#if RETAIN_CHANNELS
+    /* the default channels are refused, they are there already */
+    mutex_lock(&loramac.lock);
+    for (unsigned i = 0; i < RETAIN_CHANNELS; i++) {
+        if (retained.channels[i].Frequency != 0) {
+            LoRaMacChannelAdd(i, retained.channels[i]);
+        }
+    }
+    mutex_unlock(&loramac.lock);
+#endif
+    /* the mask last, adding a channel enables it */
+    mib.Param.ChannelsMask = retained.channels_mask;
+    _mib_set(&mib, MIB_CHANNELS_MASK);
+    mib.Param.ChannelsDatarate = retained.datarate;
+    _mib_set(&mib, MIB_CHANNELS_DATARATE);
+    mib.Param.ChannelsTxPower = retained.tx_power;
+    _mib_set(&mib, MIB_CHANNELS_TX_POWER);
+    mib.Param.AdrEnable = retained.adr;
+    _mib_set(&mib, MIB_ADR);
+    mib.Param.ReceiveDelay1 = retained.rx1_delay;
+    _mib_set(&mib, MIB_RECEIVE_DELAY_1);
+    mib.Param.ReceiveDelay2 = retained.rx2_delay;
+    _mib_set(&mib, MIB_RECEIVE_DELAY_2);
+    mib.Param.Rx2Channel = retained.rx2;
+    _mib_set(&mib, MIB_RX2_CHANNEL);
+    mib.Param.ChannelNbRep = retained.nb_rep;
+    _mib_set(&mib, MIB_CHANNELS_NB_REP);
+    mutex_lock(&loramac.lock);
+    LoRaMacParams.Rx1DrOffset = retained.rx1_dr_offset;
+    mutex_unlock(&loramac.lock);
+
+    /* set_class() only ran on the cold boot, the MAC starts in Class A */
+    lorawan_class = retained.cls;
+    semtech_loramac_set_class(&loramac, lorawan_class);
+    joined = 1;
+}
+
+static void _sleep_until_next(void)
+{
+    uint32_t awake = xtimer_now_usec();
+    uint32_t period = PERIOD * US_PER_SEC;
+    uint32_t usec = (awake + US_PER_SEC < period) ? period - awake : US_PER_SEC;
+    uint32_t time_off = _time_off_left_us();
+
+    if (time_off > usec) {
+        usec = time_off;
+    }
+
+    _save_session();
+#ifdef MODULE_LORA_CRYPTO
+    retained.crypto = lora_crypto_get_backend();
+#endif
+    if (rtc_retain_save(&retained, sizeof(retained)) < 0) {
+        LOG_WARNING("State does not fit in RTC memory, staying awake\n");
+        return;
+    }
+
+    LOG_INFO("Deep sleep for %lu ms, awake %lu ms\n",
+             (unsigned long)(usec / US_PER_MS), (unsigned long)(awake / US_PER_MS));
+    rtc_retain_sleep(usec);
+}
+#endif
+
+static uint8_t _send_message(void)
+{
+#ifdef MODULE_RTC_RETAIN
+    MibRequestConfirm_t mib;
+
+    _mark_tx();
+    /* the data rate of this uplink, ADR may change it with the downlink */
+    _mib_get(&mib, MIB_CHANNELS_DATARATE);
+    uint32_t tx_start = _rtc_seconds();
+#endif
+    LOG_INFO("Sending: %s\n", message);
+    /* The send call blocks until done, downlinks are handled by the radio
+       event afterwards */
+    uint8_t res = semtech_loramac_send(&loramac, (uint8_t *)message, strlen(message));
+    last_tx_done = xtimer_now_usec();
+    if (res != SEMTECH_LORAMAC_TX_DONE) {
+        LOG_WARNING("Sending failed: %d\n", res);
+        return res;
+    }
+#ifdef MODULE_RTC_RETAIN
+    retained.airtime_ms = _time_on_air_ms(mib.Param.ChannelsDatarate,
+                                          LORAWAN_FRAME_OVERHEAD + strlen(message));
+    retained.time_off_ms = retained.airtime_ms * (DUTY_CYCLE_INV - 1);
+    retained.tx_done_rtc = tx_start + (retained.airtime_ms + MS_PER_SEC - 1) / MS_PER_SEC;
+#endif
+    LOG_INFO("Sending done!\n");
+    return res;
+}
+
+static void _latency_add(latency_t *lat, uint32_t val)
 {
-    printf("Sending: %s\n", message);
-    /* The send call blocks until done */
-    semtech_loramac_send(&loramac, (uint8_t *)message, strlen(message));
-    /* Wait until the send cycle has completed */
-    puts("Waiting for completion...");
-    semtech_loramac_recv(&loramac);
-    puts("Sending done!");
+    if (lat->count == 0 || val < lat->min) {
+        lat->min = val;
+    }
+    if (val > lat->max) {
+        lat->max = val;
+    }
+    lat->sum += val;
+    lat->count++;
 }
 
-static void *sender(void *arg)
+static void _downlink_account(void)
 {
-    (void)arg;
+    downlink_stats_t *st = &downlink_stats[lorawan_class];
+    uint32_t now = xtimer_now_usec();
+
+    st->count++;
+#ifdef MODULE_GPIO_EVENT
+    /* the last DIO0 edge is the RxDone of this frame, TxDone comes before */
+    int line = gpio_event_line(sx127x.params.dio0_pin);
+    if (line >= 0) {
+        gpio_event_stats_t dio0;
+        gpio_event_stats(line, &dio0);
+        if (dio0.edges) {
+            _latency_add(&st->irq_us, now - dio0.last);
+        }
+    }
+#endif
+    if (lorawan_class == LORAMAC_CLASS_A) {
+        _latency_add(&st->uplink_ms, (now - last_tx_done) / US_PER_MS);
+    }
+}
 
-    msg_t msg;
-    msg_t msg_queue[8];
-    msg_init_queue(msg_queue, 8);
+static void _radio_handler(evloop_event_t *ev)
+{
+    (void)ev;
+
+    /* the flag is not counted, take every message queued so far */
+    while (msg_avail() > 0) {
+        if (semtech_loramac_recv(&loramac) != SEMTECH_LORAMAC_RX_DATA) {
+            continue;
+        }
+        _downlink_account();
 
-    puts("Startup Sender thread.");
+        LOG_INFO("Downlink on port %d, %d bytes:", loramac.rx_data.port,
+                 loramac.rx_data.payload_len);
+        for (unsigned i = 0; i < loramac.rx_data.payload_len; i++) {
+            LOG_INFO(" %02X", loramac.rx_data.payload[i]);
+        }
+        LOG_INFO("\n");
+    }
+}
 
-    while (1) {
+static void _send_handler(evloop_event_t *ev)
+{
+    (void)ev;
 
-        /* Trigger the message send */
-        _send_message();
+    if (!joined) {
+        LOG_WARNING("Not joined yet\n");
+        return;
+    }
+    /* a queued downlink would be taken for the result of the send */
+    _radio_handler(&ev_radio);
 
-        /* Schedule the next wake-up alarm */
+    /* Trigger the message send */
+    if (_send_message() != SEMTECH_LORAMAC_TX_DONE) {
+        /* no deep sleep, the next alarm tries again */
         _prepare_next_alarm();
-        puts("Waiting for trigger message");
-        msg_receive(&msg);
+        return;
     }
 
-    /* this should never be reached */
-    return NULL;
+#ifdef MODULE_RTC_RETAIN
+    if (retained.sleep && lorawan_class == LORAMAC_CLASS_A) {
+        /* downlinks of the RX windows are queued by now */
+        _radio_handler(&ev_radio);
+        _sleep_until_next();
+    }
+#endif
+
+    /* Schedule the next wake-up alarm */
+    _prepare_next_alarm();
 }
 
-int main(void)
+static void _join_handler(evloop_event_t *ev)
 {
-    uint8_t joined = 0;
+    /* Start the Over-The-Air Activation (OTAA) procedure to retrieve the
+     * generated device address and to get the network and application session
+     * keys, or activate with the ABP keys.
+     */
+    uint8_t type = nodeactivation ? LORAMAC_JOIN_OTAA : LORAMAC_JOIN_ABP;
+
+    LOG_INFO(nodeactivation ? "Starting join procedure...\n"
+                            : "Starting ABP node activation...\n");
+    if (semtech_loramac_join(&loramac, type) != SEMTECH_LORAMAC_JOIN_SUCCEEDED) {
+        LOG_WARNING("Join procedure failed, trying again in 60s\n");
+        evloop_post_in(ev, 60U * US_PER_SEC);
+        return;
+    }
 
-    puts("LoRaWAN Class A low-power application");
-    puts("=====================================");
-    printf(" -> Node activation by: ");
-    if ( nodeactivation ) {
-        puts("OTAA");
-    } else {
-        puts("ABP");
+    LOG_INFO("Join/ABP procedure succeeded\n");
+    joined = 1;
+
+    /* switch to the configured class */
+    semtech_loramac_set_class(&loramac, lorawan_class);
+    LOG_INFO(" -> LoRaWAN class %c\n", (lorawan_class == LORAMAC_CLASS_C) ? 'C' : 'A');
+
+    /* the first send, further ones are triggered by the RTC alarm */
+    evloop_post_in(&ev_send, 6U * US_PER_SEC);
+}
+
+#ifdef MODULE_GPIO_EVENT
+static void _button_handler(evloop_event_t *ev)
+{
+    (void)ev;
+    gpio_event_t edge;
+
+    while (gpio_event_get(&button_sub, &edge)) {
+        evloop_post(&ev_send);
     }
+}
+#endif
 
-    /* Create the Loramac LORAWAN stack. */
-    semtech_loramac_init(&loramac);
+static void _init_handler(evloop_event_t *ev)
+{
+    (void)ev;
+
+#ifdef MODULE_GPIO_EVENT
+    /* gpio_event wakes up the subscribing thread */
+    gpio_event_subscribe(&button_sub, 1UL << GPIO_EVENT_LINE_BUTTON0);
+#endif
+#ifdef MODULE_RTC_RETAIN
+    if (warm) {
+        /* no join, the next frame goes out as soon as the duty cycle of the
+           last one allows it, normally right away */
+        _resume();
+        uint32_t time_off = _time_off_left_us();
+        if (time_off) {
+            evloop_post_in(&ev_send, time_off);
+        }
+        else {
+            evloop_post(&ev_send);
+        }
+        return;
+    }
+#endif
+    evloop_post(&ev_join);
+}
 
-    semtech_loramac_set_tx_mode(&loramac ,  LORAMAC_TX_UNCNF );
+#ifndef MODULE_UART_RPC
+static void _latency_print(const char *name, const latency_t *lat,
+                           const char *unit)
+{
+    if (lat->count == 0) {
+        return;
+    }
+    printf("  %-18s min %lu %s, avg %lu %s, max %lu %s\n", name,
+           (unsigned long)lat->min, unit,
+           (unsigned long)(lat->sum / lat->count), unit,
+           (unsigned long)lat->max, unit);
+}
+
+static int class_cmd(int argc, char **argv)
+{
+    if (argc == 2 && (strcmp(argv[1], "a") == 0 || strcmp(argv[1], "c") == 0)) {
+        lorawan_class = (argv[1][0] == 'c') ? LORAMAC_CLASS_C : LORAMAC_CLASS_A;
+        semtech_loramac_set_class(&loramac, lorawan_class);
+        return 0;
+    }
+    if (argc == 2 && strcmp(argv[1], "reset") == 0) {
+        memset(downlink_stats, 0, sizeof(downlink_stats));
+        return 0;
+    }
+    if (argc != 1) {
+        puts("Usage: class [a | c | reset]");
+        return 1;
+    }
+
+    printf("Class %c\n", (lorawan_class == LORAMAC_CLASS_C) ? 'C' : 'A');
+    for (unsigned i = LORAMAC_CLASS_A; i <= LORAMAC_CLASS_C; i++) {
+        downlink_stats_t *st = &downlink_stats[i];
+        if (st->count == 0 || i == LORAMAC_CLASS_B) {
+            continue;
+        }
+        printf("Class %c: %lu downlinks\n", (i == LORAMAC_CLASS_C) ? 'C' : 'A',
+               (unsigned long)st->count);
+        _latency_print("RX IRQ to handler", &st->irq_us, "us");
+        _latency_print("after uplink", &st->uplink_ms, "ms");
+    }
+    return 0;
+}
+
+#ifdef MODULE_LORA_CRYPTO
+static int crypto_cmd(int argc, char **argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "selftest") == 0) {
+        printf("sw: %d\n", lora_crypto_selftest(LORA_CRYPTO_SW));
+        printf("hw: %d\n", lora_crypto_selftest(LORA_CRYPTO_HW));
+        return 0;
+    }
+    if (argc >= 2 && strcmp(argv[1], "bench") == 0) {
+        lora_crypto_bench((argc > 2) ? (unsigned)atoi(argv[2]) : 1000);
+        return 0;
+    }
+    if (argc == 3 && strcmp(argv[1], "backend") == 0) {
+        lora_crypto_backend_t backend = (strcmp(argv[2], "hw") == 0) ?
+                                        LORA_CRYPTO_HW : LORA_CRYPTO_SW;
+        if (lora_crypto_set_backend(backend) < 0) {
+            puts("backend not available");
+            return 1;
+        }
+        return 0;
+    }
+    if (argc == 1) {
+        printf("backend: %s\n",
+               (lora_crypto_get_backend() == LORA_CRYPTO_HW) ? "hw" : "sw");
+        return 0;
+    }
+    puts("Usage: crypto [selftest | bench [blocks] | backend sw|hw]");
+    return 1;
+}
+#endif
+
+static int send_cmd(int argc, char **argv)
+{
+    (void)argc;
+    (void)argv;
+
+    evloop_post(&ev_send);
+    return 0;
+}
+
+static int events_cmd(int argc, char **argv)
+{
+    if (argc == 2 && strcmp(argv[1], "reset") == 0) {
+        evloop_stats_reset();
+        return 0;
+    }
+    if (argc != 1) {
+        puts("Usage: events [reset]");
+        return 1;
+    }
 
+    evloop_print_stats();
+    return 0;
+}
 
+#ifdef MODULE_RTC_RETAIN
+static int sleep_cmd(int argc, char **argv)
+{
+    if (argc == 2 && strcmp(argv[1], "on") == 0) {
+        retained.sleep = 1;
+        return 0;
+    }
+    if (argc == 2 && strcmp(argv[1], "off") == 0) {
+        /* stay awake, and the next reset is a cold boot */
+        retained.sleep = 0;
+        rtc_retain_clear();
+        return 0;
+    }
+    if (argc != 1) {
+        puts("Usage: sleep [on | off]");
+        return 1;
+    }
+
+    rtc_retain_info_t info;
+    rtc_retain_get_info(&info);
+    printf("Deep sleep between uplinks %s, %s boot\n", retained.sleep ? "on" : "off",
+           warm ? "warm" : "cold");
+    printf("%lu wake ups, %lu s slept since the cold boot\n",
+           (unsigned long)info.wakes, (unsigned long)(info.slept_ms / MS_PER_SEC));
+    printf("Cold boot to TX: %lu ms (join included)\n",
+           (unsigned long)(retained.cold_to_tx_us / US_PER_MS));
+    printf("Last uplink %lu ms on air, band closed for %lu ms after it\n",
+           (unsigned long)retained.airtime_ms, (unsigned long)retained.time_off_ms);
+    if (retained.warm_count) {
+        printf("Wake to TX: min %lu us, avg %lu us, max %lu us\n",
+               (unsigned long)retained.warm_min_us,
+               (unsigned long)(retained.warm_sum_us / retained.warm_count),
+               (unsigned long)retained.warm_max_us);
+    }
+    return 0;
+}
+#endif
+
+#ifdef MODULE_GPIO_EVENT
+static int gpioev_cmd(int argc, char **argv)
+{
+    if (argc == 2 && strcmp(argv[1], "reset") == 0) {
+        gpio_event_stats_reset();
+        return 0;
+    }
+    if (argc != 1) {
+        puts("Usage: gpioev [reset]");
+        return 1;
+    }
+
+    gpio_event_print_stats();
+    return 0;
+}
+#endif
+
+#ifdef MODULE_STACK_USAGE
+static int stack_cmd(int argc, char **argv)
+{
+    if (argc == 2 && strcmp(argv[1], "reset") == 0) {
+        stack_usage_repaint();
+        return 0;
+    }
+    if (argc != 1) {
+        puts("Usage: stack [reset]");
+        return 1;
+    }
+
+    stack_usage_print();
+    return 0;
+}
+#endif
+
+static const shell_command_t shell_commands[] = {
+    { "class", "LoRaWAN class A/C and downlink latencies", class_cmd },
+    { "send", "Send an uplink now", send_cmd },
+    { "events", "Event loop dispatch statistics", events_cmd },
+#ifdef MODULE_RTC_RETAIN
+    { "sleep", "Deep sleep between uplinks and wake to TX times", sleep_cmd },
+#endif
+#ifdef MODULE_LORA_CRYPTO
+    { "crypto", "LoRaWAN crypto backend, self test and benchmark", crypto_cmd },
+#endif
+#ifdef MODULE_GPIO_EVENT
+    { "gpioev", "BOOT button and radio DIO IRQ latency histograms", gpioev_cmd },
+#endif
+#ifdef MODULE_STACK_USAGE
+    { "stack", "Thread stack high-water marks", stack_cmd },
+#endif
+#ifdef MODULE_PROFILER
+    { "prof", "Sampling profiler: start [hz], stop, dump", profiler_cmd },
+#endif
+    { NULL, NULL, NULL }
+};
+#endif
+
+#ifdef MODULE_UART_RPC
+/* RPC lora send command: the payload is sent as is by the loop thread, the
+   response carries the semtech_loramac_send status code. The loop thread
+   may be busy joining or waiting for the duty cycle, so the endpoint gives
+   up after RPC_SEND_TIMEOUT; the send still goes out later, and until then
+   further sends are refused. */
+#define RPC_DONE_FLAG       (1U << 1)
+#define RPC_SEND_TIMEOUT    (10U * US_PER_SEC)
+
+static evloop_event_t ev_rpc_send;
+/* owned by the loop thread while rpc_busy is set */
+static uint8_t rpc_payload[UART_RPC_PAYLOAD_MAX];
+static size_t rpc_len;
+static uint8_t rpc_res;
+static volatile uint8_t rpc_busy;
+static kernel_pid_t rpc_pid;
+
+static void _rpc_send_handler(evloop_event_t *ev)
+{
+    (void)ev;
+
+    _radio_handler(&ev_radio);
+    rpc_res = semtech_loramac_send(&loramac, rpc_payload, rpc_len);
+    last_tx_done = xtimer_now_usec();
+    rpc_busy = 0;
+    thread_flags_set((thread_t *)thread_get(rpc_pid), RPC_DONE_FLAG);
+}
+
+static int lora_send_rpc(const uint8_t *req, size_t req_len, uint8_t *resp, size_t *resp_len)
+{
+    xtimer_t timeout;
+    thread_flags_t flags;
+
+    if (rpc_busy) {
+        return -EBUSY;
+    }
+    /* req is the parser buffer of this thread */
+    memcpy(rpc_payload, req, req_len);
+    rpc_len = req_len;
+    rpc_pid = thread_getpid();
+    /* a late reply of a timed out send */
+    thread_flags_clear(RPC_DONE_FLAG);
+    rpc_busy = 1;
+    evloop_post(&ev_rpc_send);
+
+    xtimer_set_timeout_flag(&timeout, RPC_SEND_TIMEOUT);
+    flags = thread_flags_wait_any(RPC_DONE_FLAG | THREAD_FLAG_TIMEOUT);
+    xtimer_remove(&timeout);
+    thread_flags_clear(THREAD_FLAG_TIMEOUT);
+    if (!(flags & RPC_DONE_FLAG)) {
+        return -ETIMEDOUT;
+    }
+
+    resp[0] = rpc_res;
+    *resp_len = 1;
+    return (rpc_res == SEMTECH_LORAMAC_TX_DONE) ? 0 : -EIO;
+}
+
+static const uart_rpc_command_t rpc_commands[] = {
+    { 0x30, "lora_send", lora_send_rpc },
+    { 0, NULL, NULL }
+};
+#endif
+
+static void _set_keys(void)
+{
     /* Convert identifiers and application key */
     fmt_hex_bytes(deveui, DEVEUI);
     fmt_hex_bytes(appeui, APPEUI);
@@ -154,50 +904,96 @@ int main(void)
         printf("App Session Key: %02X%02X%02X%02X...\n", appskey[0], appskey[1], appskey[2], appskey[3] );
         printf("Network Session Key: %02X%02X%02X%02X...\n", nwkskey[0], nwkskey[1], nwkskey[2], nwkskey[3] );
     }
+}
 
-    /* Use a fast datarate, e.g. BW125/SF7 in EU868 */
-    semtech_loramac_set_dr(&loramac, LORAMAC_DR_1);
+int main(void)
+{
+#ifdef MODULE_RTC_RETAIN
+    warm = (rtc_retain_restore(&retained, sizeof(retained)) == 0);
+    if ( !warm ) {
+        memset(&retained, 0, sizeof(retained));
+        retained.sleep = LORAWAN_SLEEP_DEFAULT;
+    }
+#endif
 
-    while ( !joined ) {
-        /* Start the Over-The-Air Activation (OTAA) procedure to retrieve the
-         * generated device address and to get the network and application session
-         * keys.
-         */
-        joined = 1;   /* Let's assume success for now, and it fails we reset the variable. */
+    if ( warm ) {
+        puts("LoRaWAN: resumed from deep sleep");
+    } else {
+        puts("LoRaWAN Class A/C application");
+        puts("=============================");
+        printf(" -> Node activation by: ");
         if ( nodeactivation ) {
-            puts("[Sender Thread] Starting join procedure...");
-            if (semtech_loramac_join(&loramac, LORAMAC_JOIN_OTAA) != SEMTECH_LORAMAC_JOIN_SUCCEEDED) {
-                puts("Join procedure failed");
-                joined = 0;
-            }
+            puts("OTAA");
         } else {
-            puts("[Sender Thread] Starting ABP node activation...");
-            if (semtech_loramac_join(&loramac, LORAMAC_JOIN_ABP) != SEMTECH_LORAMAC_JOIN_SUCCEEDED) {
-                puts("Join procedure failed");
-                joined = 0;
-            }
+            puts("ABP");
         }
+    }
 
+#ifdef MODULE_LORA_CRYPTO
+#ifdef MODULE_RTC_RETAIN
+    if ( warm ) {
+        /* only the AES peripheral is tested again */
+        lora_crypto_resume(retained.crypto);
+    } else
+#endif
+    {
+        /* Select the AES backend before the stack uses it */
+        lora_crypto_init();
+        printf(" -> LoRaWAN crypto: %s\n",
+               (lora_crypto_get_backend() == LORA_CRYPTO_HW) ? "ESP32 AES" : "software");
+    }
+#endif
 
-        if ( !joined ) {
-            /* Should only reach this if the join failed.
-                Let's sleep for a while and try again. */
-            puts("[Sender Thread] Joined failed... Sleeping 60s...");
-            xtimer_sleep(60);
-            puts("[Sender Thread] Let's try again to join...");
-        }
+    /* Create the Loramac LORAWAN stack. */
+    semtech_loramac_init(&loramac);
+
+    semtech_loramac_set_tx_mode(&loramac ,  LORAMAC_TX_UNCNF );
+
+
+    /* the session of a warm boot is restored by the loop thread */
+    if ( !warm ) {
+        _set_keys();
     }
 
-    puts("[Sender Thread] Join/ABP procedure succeeded");
-    xtimer_sleep(4);
+    /* the radio settings of a warm boot are restored with the session */
+    if ( !warm ) {
+        /* Use a fast datarate, e.g. BW125/SF7 in EU868 */
+        semtech_loramac_set_dr(&loramac, LORAMAC_DR_1);
 
-    /* start the sender thread */
-    sender_pid = thread_create(sender_stack, sizeof(sender_stack), SENDER_PRIO, 0, sender, NULL, "sender");
+#ifdef REGION_EU868
+        /* TTN uses SF9 for RX2 in EU868, this is also where Class C listens */
+        semtech_loramac_set_rx2_dr(&loramac, LORAMAC_DR_3);
+#endif
+    }
 
-    xtimer_sleep(2);
-    /* trigger the first send */
-    puts("Send trigger message");
-    msg_t msg;
-    msg_send(&msg, sender_pid);
+    evloop_event_init(&lorawan_loop, &ev_init, "init", _init_handler);
+    evloop_event_init(&lorawan_loop, &ev_join, "join", _join_handler);
+    evloop_event_init(&lorawan_loop, &ev_send, "send", _send_handler);
+    evloop_event_init(&lorawan_loop, &ev_radio, "radio", _radio_handler);
+    evloop_set_msg_queue(&lorawan_loop, lorawan_queue, LORAWAN_QUEUE_SIZE);
+    evloop_bind_flag(&lorawan_loop, THREAD_FLAG_MSG_WAITING, &ev_radio);
+#ifdef MODULE_GPIO_EVENT
+    evloop_event_init(&lorawan_loop, &ev_button, "button", _button_handler);
+    evloop_bind_flag(&lorawan_loop, GPIO_EVENT_THREAD_FLAG, &ev_button);
+    if (gpio_event_init() < 0) {
+        puts("gpio_event init failed");
+    }
+    gpio_event_sx127x_hook(&sx127x);
+#endif
+#ifdef MODULE_UART_RPC
+    evloop_event_init(&lorawan_loop, &ev_rpc_send, "rpc_send", _rpc_send_handler);
+#endif
+
+    /* start the loop thread and let it join */
+    evloop_start(&lorawan_loop, lorawan_stack, sizeof(lorawan_stack),
+                 LORAWAN_PRIO, "lorawan");
+    evloop_post(&ev_init);
+
+#ifdef MODULE_UART_RPC
+    uart_rpc_run(rpc_commands);
+#else
+    char line_buf[SHELL_DEFAULT_BUFSIZE];
+    shell_run(shell_commands, line_buf, SHELL_DEFAULT_BUFSIZE);
+#endif
     return 0;
 }
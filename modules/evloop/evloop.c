@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2018 fcgdam
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @ingroup     ttgo_evloop
+ * @{
+ *
+ * @file
+ * @brief       Event loops implementation
+ *
+ * @author      fcgdam <primalcortex.wordpress.com>
+ * @}
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "irq.h"
+#include "thread.h"
+
+#include "evloop.h"
+
+#define ENABLE_DEBUG (0)
+#include "debug.h"
+
+static evloop_t *_loops;
+
+static void _dispatch(evloop_event_t *ev)
+{
+    uint32_t start = xtimer_now_usec();
+    uint32_t lat = start - ev->posted_at;
+
+    ev->stats.dispatched++;
+    ev->stats.lat_sum += lat;
+    if (lat > ev->stats.lat_max) {
+        ev->stats.lat_max = lat;
+    }
+    DEBUG("evloop: %s after %" PRIu32 " us\n", ev->name, lat);
+
+    ev->handler(ev);
+
+    uint32_t run = xtimer_now_usec() - start;
+    if (run > ev->stats.run_max) {
+        ev->stats.run_max = run;
+    }
+}
+
+static void *_loop_thread(void *arg)
+{
+    evloop_t *loop = arg;
+
+    if (loop->msg_queue) {
+        msg_init_queue(loop->msg_queue, loop->msg_queue_size);
+    }
+
+    while (1) {
+        thread_flags_t flags = thread_flags_wait_any(THREAD_FLAG_EVENT |
+                                                     loop->flag_mask);
+        event_t *ev;
+
+        for (unsigned i = 0; i < EVLOOP_FLAG_BINDINGS; i++) {
+            if (flags & loop->flags[i]) {
+                evloop_post(loop->flag_events[i]);
+            }
+        }
+        /* events posted while a handler runs are run in this pass, the
+         * flag they set only causes an empty pass */
+        while ((ev = event_get(&loop->queue)) != NULL) {
+            _dispatch((evloop_event_t *)ev);
+        }
+    }
+
+    return NULL;
+}
+
+static void _timer_cb(void *arg)
+{
+    evloop_post(arg);
+}
+
+void evloop_event_init(evloop_t *loop, evloop_event_t *ev, const char *name,
+                       evloop_handler_t handler)
+{
+    memset(ev, 0, sizeof(*ev));
+    ev->handler = handler;
+    ev->name = name;
+    ev->loop = loop;
+    ev->timer.callback = _timer_cb;
+    ev->timer.arg = ev;
+
+    /* append, the statistics list the events in the order of creation */
+    evloop_event_t **p = &loop->events;
+    while (*p) {
+        p = &(*p)->next;
+    }
+    *p = ev;
+}
+
+void evloop_set_msg_queue(evloop_t *loop, msg_t *queue, unsigned size)
+{
+    loop->msg_queue = queue;
+    loop->msg_queue_size = size;
+}
+
+int evloop_bind_flag(evloop_t *loop, thread_flags_t flag, evloop_event_t *ev)
+{
+    for (unsigned i = 0; i < EVLOOP_FLAG_BINDINGS; i++) {
+        if (loop->flags[i] == 0) {
+            loop->flags[i] = flag;
+            loop->flag_events[i] = ev;
+            loop->flag_mask |= flag;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+kernel_pid_t evloop_start(evloop_t *loop, char *stack, int stacksize,
+                          uint8_t prio, const char *name)
+{
+    loop->name = name;
+    loop->pid = thread_create(stack, stacksize, prio,
+                              THREAD_CREATE_SLEEPING | THREAD_CREATE_STACKTEST,
+                              _loop_thread, loop, name);
+    if (loop->pid <= KERNEL_PID_UNDEF) {
+        return loop->pid;
+    }
+
+    /* event_queue_init() makes the calling thread the waiter, the queue
+     * belongs to the loop thread */
+    memset(&loop->queue, 0, sizeof(loop->queue));
+    loop->queue.waiter = (thread_t *)thread_get(loop->pid);
+
+    loop->next = _loops;
+    _loops = loop;
+    thread_wakeup(loop->pid);
+    return loop->pid;
+}
+
+void evloop_post(evloop_event_t *ev)
+{
+    unsigned state = irq_disable();
+    int queued = (ev->super.list_node.next != NULL);
+
+    if (queued) {
+        ev->stats.coalesced++;
+    }
+    else {
+        ev->posted_at = xtimer_now_usec();
+        ev->stats.posted++;
+    }
+    irq_restore(state);
+
+    if (!queued) {
+        /* does not queue twice if an ISR posted in between */
+        event_post(&ev->loop->queue, &ev->super);
+    }
+}
+
+void evloop_post_in(evloop_event_t *ev, uint32_t usec)
+{
+    xtimer_set(&ev->timer, usec);
+}
+
+void evloop_cancel(evloop_event_t *ev)
+{
+    xtimer_remove(&ev->timer);
+    event_cancel(&ev->loop->queue, &ev->super);
+}
+
+void evloop_print_stats(void)
+{
+    puts("loop       event         posted coalesced dispatched"
+         "  lat avg  lat max  run max (us)");
+    for (evloop_t *loop = _loops; loop; loop = loop->next) {
+        for (evloop_event_t *ev = loop->events; ev; ev = ev->next) {
+            evloop_stats_t s;
+            unsigned state = irq_disable();
+
+            s = ev->stats;
+            irq_restore(state);
+            printf("%-10s %-12s %7" PRIu32 " %9" PRIu32 " %10" PRIu32
+                   " %8" PRIu32 " %8" PRIu32 " %8" PRIu32 "\n",
+                   loop->name, ev->name, s.posted, s.coalesced, s.dispatched,
+                   s.dispatched ? (uint32_t)(s.lat_sum / s.dispatched) : 0,
+                   s.lat_max, s.run_max);
+        }
+    }
+}
+
+void evloop_stats_reset(void)
+{
+    for (evloop_t *loop = _loops; loop; loop = loop->next) {
+        for (evloop_event_t *ev = loop->events; ev; ev = ev->next) {
+            unsigned state = irq_disable();
+
+            memset(&ev->stats, 0, sizeof(ev->stats));
+            irq_restore(state);
+        }
+    }
+}
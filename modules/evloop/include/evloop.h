@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2018 fcgdam
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @defgroup    ttgo_evloop Event loops with dispatch statistics
+ * @ingroup     boards_esp32_TTGO_LORA_V1
+ * @brief       Typed, coalescing events run by a few handler threads
+ *
+ * An event loop is a thread running the events posted to its RIOT event
+ * queue one after the other. Applications create one loop per priority
+ * they need instead of one thread (and stack) per activity, and post
+ * events from ISRs (RTC alarm, timers), other threads (shell) or the loop
+ * itself.
+ *
+ * Every event is a static object, so posting it again while it is still
+ * queued does nothing but count a coalesced post: ten button presses
+ * before the loop gets to run cause one dispatch.
+ *
+ * Events can also be bound to thread flags of the loop thread, e.g.
+ * THREAD_FLAG_MSG_WAITING for messages a driver or package sends to the
+ * loop thread, or GPIO_EVENT_THREAD_FLAG of the gpio_event module. Flags
+ * are not counted, so the handler of such an event must drain its source
+ * (msg_avail(), gpio_event_get()).
+ *
+ * For every event the loop keeps the number of posts, coalesced posts and
+ * dispatches, the dispatch latency (post to start of the handler) and the
+ * handler run time. For flag bound events the latency starts when the loop
+ * thread saw the flag.
+ *
+ * @{
+ *
+ * @file
+ * @author      fcgdam <primalcortex.wordpress.com>
+ */
+
+#ifndef EVLOOP_H
+#define EVLOOP_H
+
+#include <stdint.h>
+
+#include "event.h"
+#include "msg.h"
+#include "thread_flags.h"
+#include "xtimer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief   Number of thread flags that can be bound to events per loop
+ */
+#ifndef EVLOOP_FLAG_BINDINGS
+#define EVLOOP_FLAG_BINDINGS    (2U)
+#endif
+
+typedef struct evloop evloop_t;
+typedef struct evloop_event evloop_event_t;
+
+/**
+ * @brief   Event handler, runs in the loop thread
+ */
+typedef void (*evloop_handler_t)(evloop_event_t *ev);
+
+/**
+ * @brief   Statistics of one event
+ */
+typedef struct {
+    uint32_t posted;            /**< posts that queued the event */
+    uint32_t coalesced;         /**< posts while it was already queued */
+    uint32_t dispatched;        /**< handler calls */
+    uint64_t lat_sum;           /**< sum of the dispatch latencies in us */
+    uint32_t lat_max;           /**< maximum dispatch latency in us */
+    uint32_t run_max;           /**< maximum handler run time in us */
+} evloop_stats_t;
+
+/**
+ * @brief   An event
+ *
+ * Initialize with evloop_event_init(), the structure must stay valid as
+ * long as it can be posted.
+ */
+struct evloop_event {
+    event_t super;              /**< RIOT event, must be first */
+    evloop_handler_t handler;   /**< handler */
+    const char *name;           /**< name printed in the statistics */
+    evloop_t *loop;             /**< loop running the event */
+    evloop_event_t *next;       /**< next event of the same loop */
+    xtimer_t timer;             /**< timer of evloop_post_in() */
+    uint32_t posted_at;         /**< time of the post that queued it */
+    evloop_stats_t stats;       /**< statistics */
+};
+
+/**
+ * @brief   An event loop
+ */
+struct evloop {
+    event_queue_t queue;        /**< RIOT event queue of the loop thread */
+    const char *name;           /**< thread name */
+    kernel_pid_t pid;           /**< loop thread */
+    evloop_event_t *events;     /**< events of this loop */
+    evloop_t *next;             /**< next loop */
+    msg_t *msg_queue;           /**< message queue of the loop thread */
+    unsigned msg_queue_size;    /**< size of the message queue */
+    thread_flags_t flag_mask;   /**< all bound flags */
+    thread_flags_t flags[EVLOOP_FLAG_BINDINGS];         /**< bound flags */
+    evloop_event_t *flag_events[EVLOOP_FLAG_BINDINGS];  /**< their events */
+};
+
+/**
+ * @brief   Initialize an event of a loop
+ *
+ * @param[in]  loop     loop running the event, evloop_start() may be
+ *                      called later
+ * @param[out] ev       event to initialize
+ * @param[in]  name     name for the statistics
+ * @param[in]  handler  handler
+ */
+void evloop_event_init(evloop_t *loop, evloop_event_t *ev, const char *name,
+                       evloop_handler_t handler);
+
+/**
+ * @brief   Give the loop thread a message queue
+ *
+ * Needed when drivers or packages send messages to the loop thread. Call
+ * before evloop_start().
+ *
+ * @param[in] loop      the loop
+ * @param[in] queue     message array, size must be a power of 2
+ * @param[in] size      number of messages
+ */
+void evloop_set_msg_queue(evloop_t *loop, msg_t *queue, unsigned size);
+
+/**
+ * @brief   Post an event when a thread flag of the loop thread is set
+ *
+ * Call before evloop_start().
+ *
+ * @return  0 on success
+ * @return  -1 if all @ref EVLOOP_FLAG_BINDINGS are used
+ */
+int evloop_bind_flag(evloop_t *loop, thread_flags_t flag, evloop_event_t *ev);
+
+/**
+ * @brief   Create the loop thread
+ *
+ * @param[in] loop      the loop
+ * @param[in] stack     stack of the loop thread
+ * @param[in] stacksize size of @p stack
+ * @param[in] prio      priority of the loop thread
+ * @param[in] name      thread name
+ *
+ * @return  pid of the loop thread, or a negative error from thread_create()
+ */
+kernel_pid_t evloop_start(evloop_t *loop, char *stack, int stacksize,
+                          uint8_t prio, const char *name);
+
+/**
+ * @brief   Post an event to its loop, also from interrupt context
+ *
+ * Does nothing but count a coalesced post if the event is queued already.
+ */
+void evloop_post(evloop_event_t *ev);
+
+/**
+ * @brief   Post an event after a delay
+ *
+ * A pending delayed post of the same event is replaced.
+ *
+ * @param[in] ev        the event
+ * @param[in] usec      delay in microseconds
+ */
+void evloop_post_in(evloop_event_t *ev, uint32_t usec);
+
+/**
+ * @brief   Cancel a delayed post and remove the event from its queue
+ */
+void evloop_cancel(evloop_event_t *ev);
+
+/**
+ * @brief   Print the statistics of all events of all loops
+ */
+void evloop_print_stats(void);
+
+/**
+ * @brief   Clear the statistics of all events
+ */
+void evloop_stats_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EVLOOP_H */
+/** @} */
@@ -0,0 +1,261 @@
+/*
+ * Copyright (C) 2018 fcgdam
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @ingroup     ttgo_gpio_event
+ * @{
+ *
+ * @file
+ * @brief       Timestamped GPIO event dispatcher implementation
+ *
+ * @author      fcgdam <primalcortex.wordpress.com>
+ * @}
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "irq.h"
+#include "thread.h"
+#include "thread_flags.h"
+#include "xtimer.h"
+
+#include "gpio_event.h"
+#include "gpio_event_params.h"
+
+#define ENABLE_DEBUG (0)
+#include "debug.h"
+
+#define GPIO_EVENT_NUMOF    (sizeof(gpio_event_params) / sizeof(gpio_event_params[0]))
+#define QUEUE_MASK          (GPIO_EVENT_QUEUE_SIZE - 1)
+
+#if (GPIO_EVENT_QUEUE_SIZE & QUEUE_MASK)
+#error "GPIO_EVENT_QUEUE_SIZE must be a power of 2"
+#endif
+
+static gpio_event_sub_t *_subs;
+static gpio_event_stats_t _stats[GPIO_EVENT_NUMOF];
+static uint8_t _seen[GPIO_EVENT_NUMOF];
+
+static void _isr(void *arg)
+{
+    gpio_event_post((unsigned)(uintptr_t)arg);
+}
+
+int gpio_event_init(void)
+{
+    for (unsigned i = 0; i < GPIO_EVENT_NUMOF; i++) {
+        const gpio_event_params_t *p = &gpio_event_params[i];
+
+        if (p->flags & GPIO_EVENT_PASSIVE) {
+            DEBUG("gpio_event: line %s is passive\n", p->name);
+            continue;
+        }
+        if (gpio_init_int(p->pin, p->mode, p->flank, _isr,
+                          (void *)(uintptr_t)i) < 0) {
+            DEBUG("gpio_event: init of line %s failed\n", p->name);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+unsigned gpio_event_numof(void)
+{
+    return GPIO_EVENT_NUMOF;
+}
+
+const char *gpio_event_name(unsigned line)
+{
+    return (line < GPIO_EVENT_NUMOF) ? gpio_event_params[line].name : NULL;
+}
+
+int gpio_event_line(gpio_t pin)
+{
+    for (unsigned i = 0; i < GPIO_EVENT_NUMOF; i++) {
+        if (gpio_event_params[i].pin == pin) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void gpio_event_subscribe(gpio_event_sub_t *sub, uint32_t lines)
+{
+    sub->pid = thread_getpid();
+    sub->lines = lines;
+    sub->dropped = 0;
+    sub->head = 0;
+    sub->tail = 0;
+
+    unsigned state = irq_disable();
+    sub->next = _subs;
+    _subs = sub;
+    irq_restore(state);
+}
+
+void gpio_event_unsubscribe(gpio_event_sub_t *sub)
+{
+    unsigned state = irq_disable();
+    for (gpio_event_sub_t **s = &_subs; *s; s = &(*s)->next) {
+        if (*s == sub) {
+            *s = sub->next;
+            break;
+        }
+    }
+    irq_restore(state);
+}
+
+void gpio_event_post(unsigned line)
+{
+    /* read the timer first, everything else is overhead */
+    uint32_t now = xtimer_now_usec();
+
+    if (line >= GPIO_EVENT_NUMOF) {
+        return;
+    }
+
+    const gpio_event_params_t *p = &gpio_event_params[line];
+    gpio_event_stats_t *st = &_stats[line];
+
+    if (_seen[line] && ((now - st->last) < p->debounce_us)) {
+        st->bounces++;
+        return;
+    }
+    _seen[line] = 1;
+    st->last = now;
+    st->edges++;
+
+    gpio_event_t ev = {
+        .time = now,
+        .line = line,
+        .level = (gpio_read(p->pin) != 0),
+    };
+
+    for (gpio_event_sub_t *sub = _subs; sub; sub = sub->next) {
+        if (!(sub->lines & (1UL << line))) {
+            continue;
+        }
+        unsigned head = sub->head;
+        if ((head - sub->tail) >= GPIO_EVENT_QUEUE_SIZE) {
+            sub->dropped++;
+            continue;
+        }
+        sub->queue[head & QUEUE_MASK] = ev;
+        /* the slot must be written before the consumer can see it */
+        __atomic_signal_fence(__ATOMIC_RELEASE);
+        sub->head = head + 1;
+        thread_flags_set((thread_t *)thread_get(sub->pid),
+                         GPIO_EVENT_THREAD_FLAG);
+    }
+}
+
+static unsigned _bucket(uint32_t lat)
+{
+    unsigned b = 0;
+
+    while ((lat >>= 1) && (b < (GPIO_EVENT_HIST_BUCKETS - 1))) {
+        b++;
+    }
+    return b;
+}
+
+/* called with interrupts disabled */
+static void _account(gpio_event_stats_t *st, uint32_t lat)
+{
+    st->hist[_bucket(lat)]++;
+    if (lat > st->lat_max) {
+        st->lat_max = lat;
+    }
+}
+
+int gpio_event_get(gpio_event_sub_t *sub, gpio_event_t *ev)
+{
+    unsigned tail = sub->tail;
+
+    if (tail == sub->head) {
+        return 0;
+    }
+    /* pairs with the release fence in gpio_event_post() */
+    __atomic_signal_fence(__ATOMIC_ACQUIRE);
+    *ev = sub->queue[tail & QUEUE_MASK];
+    /* don't hand the slot back before it has been read */
+    __atomic_signal_fence(__ATOMIC_RELEASE);
+    sub->tail = tail + 1;
+
+    /* several subscribers may account the same line */
+    unsigned state = irq_disable();
+    _account(&_stats[ev->line], xtimer_now_usec() - ev->time);
+    irq_restore(state);
+
+    return 1;
+}
+
+void gpio_event_handled(unsigned line)
+{
+    if (line >= GPIO_EVENT_NUMOF) {
+        return;
+    }
+
+    unsigned state = irq_disable();
+    _account(&_stats[line], xtimer_now_usec() - _stats[line].last);
+    irq_restore(state);
+}
+
+void gpio_event_wait(gpio_event_sub_t *sub, gpio_event_t *ev)
+{
+    while (!gpio_event_get(sub, ev)) {
+        thread_flags_wait_any(GPIO_EVENT_THREAD_FLAG);
+    }
+}
+
+void gpio_event_stats(unsigned line, gpio_event_stats_t *stats)
+{
+    if (line >= GPIO_EVENT_NUMOF) {
+        return;
+    }
+    unsigned state = irq_disable();
+    *stats = _stats[line];
+    irq_restore(state);
+}
+
+void gpio_event_stats_reset(void)
+{
+    unsigned state = irq_disable();
+    memset(_stats, 0, sizeof(_stats));
+    memset(_seen, 0, sizeof(_seen));
+    irq_restore(state);
+}
+
+void gpio_event_print_stats(void)
+{
+    gpio_event_stats_t st;
+
+    for (unsigned i = 0; i < GPIO_EVENT_NUMOF; i++) {
+        gpio_event_stats(i, &st);
+        printf("%-5s edges: %" PRIu32 " bounces: %" PRIu32
+               " max latency: %" PRIu32 " us%s\n",
+               gpio_event_params[i].name, st.edges, st.bounces, st.lat_max,
+               (gpio_event_params[i].flags & GPIO_EVENT_PASSIVE) ?
+               " (passive)" : "");
+        for (unsigned b = 0; b < GPIO_EVENT_HIST_BUCKETS; b++) {
+            if (!st.hist[b]) {
+                continue;
+            }
+            if (b == (GPIO_EVENT_HIST_BUCKETS - 1)) {
+                printf("      >= %6lu us: %" PRIu32 "\n",
+                       1UL << b, st.hist[b]);
+            }
+            else {
+                printf("      <  %6lu us: %" PRIu32 "\n",
+                       2UL << b, st.hist[b]);
+            }
+        }
+    }
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2018 fcgdam
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @ingroup     ttgo_gpio_event
+ * @{
+ *
+ * @file
+ * @brief       DIO interrupt timing of the sx127x radio
+ *
+ * @author      fcgdam <primalcortex.wordpress.com>
+ * @}
+ */
+
+#ifdef MODULE_SX127X
+
+#include "irq.h"
+
+#include "gpio_event.h"
+
+#define DIO_NUMOF           (4U)
+
+static netdev_event_cb_t _next_cb;
+static int _lines[DIO_NUMOF];
+static const uint8_t _flags[DIO_NUMOF] = {
+    SX127X_IRQ_DIO0, SX127X_IRQ_DIO1, SX127X_IRQ_DIO2, SX127X_IRQ_DIO3,
+};
+/* DIO flags posted but not handled yet */
+static uint8_t _pending;
+
+static void _event_cb(netdev_t *netdev, netdev_event_t event)
+{
+    sx127x_t *dev = (sx127x_t *)netdev;
+
+    if (event == NETDEV_EVENT_ISR) {
+        /* in the DIO ISR, the flag of the pin is set already */
+        uint8_t fresh = dev->irq & ~_pending;
+
+        _pending |= fresh;
+        for (unsigned i = 0; i < DIO_NUMOF; i++) {
+            if ((fresh & _flags[i]) && (_lines[i] >= 0)) {
+                gpio_event_post(_lines[i]);
+            }
+        }
+    }
+    else {
+        /* reported by the thread that handles the interrupt */
+        unsigned state = irq_disable();
+        uint8_t done = _pending;
+        _pending = 0;
+        irq_restore(state);
+
+        for (unsigned i = 0; i < DIO_NUMOF; i++) {
+            if ((done & _flags[i]) && (_lines[i] >= 0)) {
+                gpio_event_handled(_lines[i]);
+            }
+        }
+    }
+    _next_cb(netdev, event);
+}
+
+void gpio_event_sx127x_hook(sx127x_t *dev)
+{
+    _lines[0] = gpio_event_line(dev->params.dio0_pin);
+    _lines[1] = gpio_event_line(dev->params.dio1_pin);
+    _lines[2] = gpio_event_line(dev->params.dio2_pin);
+    _lines[3] = gpio_event_line(dev->params.dio3_pin);
+
+    unsigned state = irq_disable();
+    _next_cb = dev->netdev.event_callback;
+    dev->netdev.event_callback = _event_cb;
+    irq_restore(state);
+}
+
+#else
+typedef int dont_be_pedantic;
+#endif /* MODULE_SX127X */
@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2018 fcgdam
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @defgroup    ttgo_gpio_event Timestamped GPIO event dispatcher
+ * @ingroup     boards_esp32_TTGO_LORA_V1
+ * @brief       Edge events for the button and SX1276 DIO lines
+ *
+ * Every configured line (see gpio_event_params.h) gets an interrupt handler
+ * that reads the hardware timer on entry, debounces the edge against the
+ * timestamp of the last accepted edge and pushes the event into the queue of
+ * every thread subscribed to that line. The queues are single producer
+ * (the GPIO ISR) / single consumer (the subscribed thread) ring buffers, so
+ * neither side ever has to lock. Subscribers are woken with a thread flag.
+ *
+ * When an event is taken out of a queue, the time between the ISR and the
+ * handler is added to a per-line log2 latency histogram.
+ *
+ * Lines marked with @ref GPIO_EVENT_PASSIVE are not hooked by this module,
+ * because another driver (e.g. sx127x for the DIO lines) owns the interrupt.
+ * That driver's ISR can call gpio_event_post() to get the same timestamping,
+ * and the thread handling the interrupt gpio_event_handled() for the latency
+ * accounting. gpio_event_sx127x_hook() does both for the sx127x DIO lines
+ * from the netdev event callback of the radio.
+ *
+ * @{
+ *
+ * @file
+ * @author      fcgdam <primalcortex.wordpress.com>
+ */
+
+#ifndef GPIO_EVENT_H
+#define GPIO_EVENT_H
+
+#include <stdint.h>
+
+#include "kernel_types.h"
+#include "periph/gpio.h"
+
+#ifdef MODULE_SX127X
+#include "sx127x.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief   Number of events each subscriber can hold, must be a power of 2
+ */
+#ifndef GPIO_EVENT_QUEUE_SIZE
+#define GPIO_EVENT_QUEUE_SIZE       (8U)
+#endif
+
+/**
+ * @brief   Number of log2 buckets of the latency histogram
+ *
+ * Bucket 0 counts latencies below 2us, bucket n latencies in
+ * [2^n, 2^(n+1)) us, the last bucket everything above.
+ */
+#ifndef GPIO_EVENT_HIST_BUCKETS
+#define GPIO_EVENT_HIST_BUCKETS     (16U)
+#endif
+
+/**
+ * @brief   Thread flag used to wake up subscribers
+ */
+#ifndef GPIO_EVENT_THREAD_FLAG
+#define GPIO_EVENT_THREAD_FLAG      (1U << 13)
+#endif
+
+/**
+ * @brief   Line is not hooked by gpio_event_init(), see gpio_event_post()
+ */
+#define GPIO_EVENT_PASSIVE          (0x01)
+
+/**
+ * @brief   Configuration of one event line
+ */
+typedef struct {
+    const char *name;           /**< name printed in the statistics */
+    gpio_t pin;                 /**< GPIO of the line */
+    gpio_mode_t mode;           /**< input mode (pull-ups etc.) */
+    gpio_flank_t flank;         /**< edge(s) generating an event */
+    uint32_t debounce_us;       /**< minimum time between two edges in us */
+    uint8_t flags;              /**< GPIO_EVENT_* flags */
+} gpio_event_params_t;
+
+/**
+ * @brief   An edge event
+ */
+typedef struct {
+    uint32_t time;              /**< xtimer time in us taken in the ISR */
+    uint8_t line;               /**< index of the line in gpio_event_params */
+    uint8_t level;              /**< level of the pin read in the ISR */
+} gpio_event_t;
+
+/**
+ * @brief   A subscriber and its event queue
+ *
+ * @note    The structure is written by the ISR, so it has to stay valid
+ *          until gpio_event_unsubscribe() is called.
+ */
+typedef struct gpio_event_sub {
+    struct gpio_event_sub *next;            /**< next subscriber */
+    kernel_pid_t pid;                       /**< thread to wake up */
+    uint32_t lines;                         /**< bitmask of subscribed lines */
+    uint32_t dropped;                       /**< events lost on a full queue */
+    volatile unsigned head;                 /**< written by the ISR only */
+    volatile unsigned tail;                 /**< written by the thread only */
+    gpio_event_t queue[GPIO_EVENT_QUEUE_SIZE];  /**< the events */
+} gpio_event_sub_t;
+
+/**
+ * @brief   Statistics of one line
+ */
+typedef struct {
+    uint32_t edges;             /**< accepted edges */
+    uint32_t bounces;           /**< edges rejected by the debouncer */
+    uint32_t last;              /**< time of the last accepted edge */
+    uint32_t lat_max;           /**< maximum IRQ-to-handler latency in us */
+    uint32_t hist[GPIO_EVENT_HIST_BUCKETS]; /**< latency histogram */
+} gpio_event_stats_t;
+
+/**
+ * @brief   Hook the interrupts of all configured lines
+ *
+ * @return  0 on success
+ * @return  -1 if a line could not be initialized
+ */
+int gpio_event_init(void);
+
+/**
+ * @brief   Number of configured lines
+ */
+unsigned gpio_event_numof(void);
+
+/**
+ * @brief   Name of a line
+ */
+const char *gpio_event_name(unsigned line);
+
+/**
+ * @brief   Find the line number of a pin
+ *
+ * @return  the line number or -1 if the pin is not configured
+ */
+int gpio_event_line(gpio_t pin);
+
+/**
+ * @brief   Subscribe the calling thread to a set of lines
+ *
+ * @param[out] sub      subscriber structure, must stay valid
+ * @param[in]  lines    bitmask of lines, bit n is line n
+ */
+void gpio_event_subscribe(gpio_event_sub_t *sub, uint32_t lines);
+
+/**
+ * @brief   Remove a subscriber
+ */
+void gpio_event_unsubscribe(gpio_event_sub_t *sub);
+
+/**
+ * @brief   Take the next event out of the queue without blocking
+ *
+ * @return  1 if @p ev was filled, 0 if the queue is empty
+ */
+int gpio_event_get(gpio_event_sub_t *sub, gpio_event_t *ev);
+
+/**
+ * @brief   Wait for the next event
+ *
+ * Must be called from the thread that subscribed.
+ */
+void gpio_event_wait(gpio_event_sub_t *sub, gpio_event_t *ev);
+
+/**
+ * @brief   Timestamp and dispatch an edge of a line from interrupt context
+ *
+ * This is the handler installed for all non-passive lines. Drivers owning
+ * the interrupt of a passive line call it first thing in their ISR.
+ */
+void gpio_event_post(unsigned line);
+
+/**
+ * @brief   Account the latency of the last edge of a passive line
+ *
+ * Called by the thread handling the interrupt of a passive line, the time
+ * since the last gpio_event_post() of @p line goes into its histogram.
+ */
+void gpio_event_handled(unsigned line);
+
+#if defined(MODULE_SX127X) || defined(DOXYGEN)
+/**
+ * @brief   Time the DIO interrupts of a sx127x radio
+ *
+ * Interposes on the netdev event callback of @p dev: the NETDEV_EVENT_ISR
+ * the DIO ISRs report is posted on the line of that DIO pin, the first event
+ * reported by the thread that handles the interrupt (e.g. TX_COMPLETE in
+ * the MAC thread) accounts the latency. Must be called after the callback
+ * has been set, i.e. after semtech_loramac_init().
+ *
+ * A DIO interrupt the driver handles without reporting an event is
+ * accounted with the next event.
+ *
+ * @param[in] dev   radio device
+ */
+void gpio_event_sx127x_hook(sx127x_t *dev);
+#endif
+
+/**
+ * @brief   Get a snapshot of the statistics of a line
+ */
+void gpio_event_stats(unsigned line, gpio_event_stats_t *stats);
+
+/**
+ * @brief   Clear the statistics of all lines
+ */
+void gpio_event_stats_reset(void);
+
+/**
+ * @brief   Print the statistics and latency histograms of all lines
+ */
+void gpio_event_print_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GPIO_EVENT_H */
+/** @} */
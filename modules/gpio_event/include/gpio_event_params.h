@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2018 fcgdam
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @ingroup     ttgo_gpio_event
+ * @brief       Default configuration of the GPIO event lines
+ *
+ * The BOOT button and the three SX1276 DIO lines of the TTGO board. The
+ * button is active low with an external pull-up, so it triggers on the
+ * falling edge. The DIO lines are passive when the sx127x driver is used,
+ * since the driver installs its own handlers on them. They are then timed
+ * through the netdev event callback of the radio, see
+ * gpio_event_sx127x_hook().
+ *
+ * @{
+ * @file
+ * @author      fcgdam <primalcortex.wordpress.com>
+ */
+
+#ifndef GPIO_EVENT_PARAMS_H
+#define GPIO_EVENT_PARAMS_H
+
+#include "board.h"
+#include "gpio_event.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief   Debounce time of the BOOT button
+ */
+#ifndef GPIO_EVENT_BUTTON_DEBOUNCE_US
+#define GPIO_EVENT_BUTTON_DEBOUNCE_US   (20000U)
+#endif
+
+/**
+ * @brief   Flags of the radio DIO lines
+ */
+#ifndef GPIO_EVENT_DIO_FLAGS
+#ifdef MODULE_SX127X
+#define GPIO_EVENT_DIO_FLAGS            (GPIO_EVENT_PASSIVE)
+#else
+#define GPIO_EVENT_DIO_FLAGS            (0)
+#endif
+#endif
+
+/**
+ * @brief   Line configuration
+ */
+#ifndef GPIO_EVENT_PARAMS
+#define GPIO_EVENT_PARAMS \
+    { .name = "BOOT", .pin = BUTTON0_PIN, .mode = GPIO_IN, \
+      .flank = GPIO_FALLING, .debounce_us = GPIO_EVENT_BUTTON_DEBOUNCE_US, \
+      .flags = 0 }, \
+    { .name = "DIO0", .pin = SX127X_PARAM_DIO0, .mode = GPIO_IN, \
+      .flank = GPIO_RISING, .debounce_us = 0, \
+      .flags = GPIO_EVENT_DIO_FLAGS }, \
+    { .name = "DIO1", .pin = SX127X_PARAM_DIO1, .mode = GPIO_IN, \
+      .flank = GPIO_RISING, .debounce_us = 0, \
+      .flags = GPIO_EVENT_DIO_FLAGS }, \
+    { .name = "DIO2", .pin = SX127X_PARAM_DIO2, .mode = GPIO_IN, \
+      .flank = GPIO_RISING, .debounce_us = 0, \
+      .flags = GPIO_EVENT_DIO_FLAGS },
+#endif
+
+/**
+ * @brief   Index of the BOOT button line in the default configuration
+ */
+#define GPIO_EVENT_LINE_BUTTON0         (0U)
+
+/**
+ * @brief   Configured lines
+ */
+static const gpio_event_params_t gpio_event_params[] =
+{
+    GPIO_EVENT_PARAMS
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GPIO_EVENT_PARAMS_H */
+/** @} */
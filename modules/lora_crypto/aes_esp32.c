@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2018 fcgdam
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @ingroup     ttgo_lora_crypto
+ * @{
+ *
+ * @file
+ * @brief       AES-128 encryption with the ESP32 AES peripheral
+ *
+ * Register layout from the ESP32 Technical Reference Manual, chapter AES
+ * Accelerator. Key and text registers take the data as little endian words,
+ * as the esp-idf driver writes them.
+ *
+ * @author      fcgdam <primalcortex.wordpress.com>
+ * @}
+ */
+
+#include "lora_crypto.h"
+
+#ifdef LORA_CRYPTO_HAVE_HW
+
+#include <string.h>
+
+#include "irq.h"
+
+#define DPORT_PERI_CLK_EN_REG   (0x3ff0001cUL)
+#define DPORT_PERI_RST_EN_REG   (0x3ff00020UL)
+#define DPORT_PERI_EN_AES       (1UL << 0)
+
+#define AES_START_REG           (0x3ff01000UL)
+#define AES_IDLE_REG            (0x3ff01004UL)
+#define AES_MODE_REG            (0x3ff01008UL)
+#define AES_KEY_REG(i)          (0x3ff01010UL + ((i) << 2))
+#define AES_TEXT_REG(i)         (0x3ff01030UL + ((i) << 2))
+
+#define AES_MODE_ENC_128        (0U)
+
+#define REG(addr)               (*(volatile uint32_t *)(addr))
+
+#define BSWAP32(x)              __builtin_bswap32(x)
+
+/* round key words 0..3 of the key currently in the peripheral */
+static uint32_t _loaded[4];
+static uint8_t _loaded_valid;
+
+void lora_aes_hw_init(void)
+{
+    REG(DPORT_PERI_CLK_EN_REG) |= DPORT_PERI_EN_AES;
+    REG(DPORT_PERI_RST_EN_REG) &= ~DPORT_PERI_EN_AES;
+    REG(AES_MODE_REG) = AES_MODE_ENC_128;
+    _loaded_valid = 0;
+}
+
+void lora_aes_hw_encrypt(const lora_aes_ctx_t *ctx,
+                         const uint8_t in[LORA_AES_BLOCK_SIZE],
+                         uint8_t out[LORA_AES_BLOCK_SIZE])
+{
+    uint32_t w[4];
+
+    memcpy(w, in, sizeof(w));
+
+    /* the engine is shared, a block takes less than 100 cycles */
+    unsigned state = irq_disable();
+
+    if (!_loaded_valid || memcmp(_loaded, ctx->rk, sizeof(_loaded))) {
+        /* rk[] holds the key as big endian words */
+        for (unsigned i = 0; i < 4; i++) {
+            REG(AES_KEY_REG(i)) = BSWAP32(ctx->rk[i]);
+        }
+        memcpy(_loaded, ctx->rk, sizeof(_loaded));
+        _loaded_valid = 1;
+    }
+
+    for (unsigned i = 0; i < 4; i++) {
+        REG(AES_TEXT_REG(i)) = w[i];
+    }
+    REG(AES_START_REG) = 1;
+    while (REG(AES_IDLE_REG) != 1) {}
+    for (unsigned i = 0; i < 4; i++) {
+        w[i] = REG(AES_TEXT_REG(i));
+    }
+
+    irq_restore(state);
+
+    memcpy(out, w, sizeof(w));
+}
+
+#else
+typedef int dont_be_pedantic;
+#endif /* LORA_CRYPTO_HAVE_HW */
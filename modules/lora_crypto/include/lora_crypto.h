@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2018 fcgdam
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @defgroup    ttgo_lora_crypto AES/CMAC backend for LoRaWAN
+ * @ingroup     boards_esp32_TTGO_LORA_V1
+ * @brief       Hardware accelerated AES-128 and AES-CMAC for semtech-loramac
+ *
+ * The semtech-loramac package encrypts the payload (AES-CTR like keystream)
+ * and computes the MIC (AES-CMAC) of every frame with its own byte oriented
+ * AES. This module replaces the package's `aes_set_key`/`aes_encrypt` and
+ * `AES_CMAC_*` functions (module semtech_loramac_crypto) by:
+ *
+ * - the AES peripheral of the ESP32, when lora_crypto_init() verified it
+ *   against the FIPS-197 known answer,
+ * - a 32 bit table based software AES otherwise, e.g. on native.
+ *
+ * Both backends share the same key schedule format, so the backend can be
+ * switched at run time with lora_crypto_set_backend().
+ *
+ * @{
+ *
+ * @file
+ * @author      fcgdam <primalcortex.wordpress.com>
+ */
+
+#ifndef LORA_CRYPTO_H
+#define LORA_CRYPTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief   The ESP32 AES peripheral is available
+ */
+#if defined(CPU_ESP32) && !defined(LORA_CRYPTO_NO_HW)
+#define LORA_CRYPTO_HAVE_HW     (1)
+#endif
+
+#define LORA_AES_BLOCK_SIZE     (16U)   /**< AES block size */
+#define LORA_AES_KEY_SIZE       (16U)   /**< AES-128 key size */
+#define LORA_AES_RK_WORDS       (44U)   /**< AES-128 round key words */
+
+/**
+ * @name    Direction of a LoRaWAN frame
+ * @{
+ */
+#define LORA_CRYPTO_UPLINK      (0U)
+#define LORA_CRYPTO_DOWNLINK    (1U)
+/** @} */
+
+/**
+ * @brief   Backends
+ */
+typedef enum {
+    LORA_CRYPTO_SW,             /**< table based software AES */
+    LORA_CRYPTO_HW,             /**< ESP32 AES peripheral */
+} lora_crypto_backend_t;
+
+/**
+ * @brief   Expanded AES-128 key
+ *
+ * rk[0..3] is the key itself as big endian words.
+ */
+typedef struct {
+    uint32_t rk[LORA_AES_RK_WORDS];     /**< round keys */
+} lora_aes_ctx_t;
+
+/**
+ * @brief   CMAC state
+ */
+typedef struct {
+    lora_aes_ctx_t aes;                 /**< key */
+    uint8_t x[LORA_AES_BLOCK_SIZE];     /**< chaining value */
+    uint8_t last[LORA_AES_BLOCK_SIZE];  /**< last (partial) block */
+    uint32_t n;                         /**< bytes in last */
+} lora_cmac_t;
+
+/**
+ * @brief   Select the best working backend
+ *
+ * Runs a known answer test on the AES peripheral and uses it if it passes.
+ * Call it before semtech_loramac_init(), the software backend is used
+ * until then.
+ */
+void lora_crypto_init(void);
+
+/**
+ * @brief   Use a backend selected before a deep sleep
+ *
+ * Skips powering up and testing the AES peripheral when the software
+ * backend was used. A retained hardware backend is not trusted: the
+ * peripheral is powered up and has to pass the known answer test again,
+ * otherwise the software backend is used.
+ */
+void lora_crypto_resume(lora_crypto_backend_t backend);
+
+/**
+ * @brief   Force a backend
+ *
+ * @return  0 on success
+ * @return  -ENOTSUP if the backend is not available on this CPU
+ * @return  -EIO if the AES peripheral failed the known answer test of
+ *          lora_crypto_init() or lora_crypto_resume()
+ */
+int lora_crypto_set_backend(lora_crypto_backend_t backend);
+
+/**
+ * @brief   Backend currently used
+ */
+lora_crypto_backend_t lora_crypto_get_backend(void);
+
+/**
+ * @brief   Expand an AES-128 key
+ */
+void lora_aes_setkey(lora_aes_ctx_t *ctx, const uint8_t key[LORA_AES_KEY_SIZE]);
+
+/**
+ * @brief   Encrypt one block with the current backend
+ */
+void lora_aes_encrypt(const lora_aes_ctx_t *ctx,
+                      const uint8_t in[LORA_AES_BLOCK_SIZE],
+                      uint8_t out[LORA_AES_BLOCK_SIZE]);
+
+/**
+ * @brief   Encrypt one block in software
+ */
+void lora_aes_sw_encrypt(const lora_aes_ctx_t *ctx,
+                         const uint8_t in[LORA_AES_BLOCK_SIZE],
+                         uint8_t out[LORA_AES_BLOCK_SIZE]);
+
+#if defined(LORA_CRYPTO_HAVE_HW) || defined(DOXYGEN)
+/**
+ * @brief   Power up the AES peripheral
+ */
+void lora_aes_hw_init(void);
+
+/**
+ * @brief   Encrypt one block with the AES peripheral
+ *
+ * The key is only written to the peripheral when it changed since the
+ * last call.
+ */
+void lora_aes_hw_encrypt(const lora_aes_ctx_t *ctx,
+                         const uint8_t in[LORA_AES_BLOCK_SIZE],
+                         uint8_t out[LORA_AES_BLOCK_SIZE]);
+#endif
+
+/**
+ * @brief   Absorb data into a CMAC chaining value
+ *
+ * Low level form used by the semtech-loramac glue, which keeps the state in
+ * the package's own context structure. The last block is always kept in
+ * @p last, since it is processed differently by lora_cmac_final_raw().
+ */
+void lora_cmac_update_raw(const lora_aes_ctx_t *aes, uint8_t x[16],
+                          uint8_t last[16], uint32_t *n,
+                          const uint8_t *data, size_t len);
+
+/**
+ * @brief   Finish a CMAC computation, see lora_cmac_update_raw()
+ */
+void lora_cmac_final_raw(const lora_aes_ctx_t *aes, const uint8_t x[16],
+                         uint8_t last[16], uint32_t n, uint8_t mac[16]);
+
+/**
+ * @brief   Start a CMAC computation
+ */
+void lora_cmac_init(lora_cmac_t *ctx, const uint8_t key[LORA_AES_KEY_SIZE]);
+
+/**
+ * @brief   Add data to a CMAC computation
+ */
+void lora_cmac_update(lora_cmac_t *ctx, const uint8_t *data, size_t len);
+
+/**
+ * @brief   Get the CMAC
+ */
+void lora_cmac_final(lora_cmac_t *ctx, uint8_t mac[LORA_AES_BLOCK_SIZE]);
+
+/**
+ * @brief   LoRaWAN 1.0 frame MIC (B0 block followed by the frame)
+ *
+ * @param[in]  buf      MHDR .. end of the FRMPayload
+ * @param[in]  size     length of @p buf
+ * @param[in]  key      NwkSKey
+ * @param[in]  address  DevAddr
+ * @param[in]  dir      LORA_CRYPTO_UPLINK or LORA_CRYPTO_DOWNLINK
+ * @param[in]  seq      frame counter
+ *
+ * @return  the MIC, the first CMAC byte is the least significant byte
+ */
+uint32_t lora_crypto_compute_mic(const uint8_t *buf, size_t size,
+                                 const uint8_t key[LORA_AES_KEY_SIZE],
+                                 uint32_t address, uint8_t dir, uint32_t seq);
+
+/**
+ * @brief   LoRaWAN 1.0 FRMPayload encryption, also used for decryption
+ *
+ * @param[in]  buf      FRMPayload
+ * @param[in]  size     length of @p buf
+ * @param[in]  key      AppSKey (or NwkSKey for port 0)
+ * @param[in]  address  DevAddr
+ * @param[in]  dir      LORA_CRYPTO_UPLINK or LORA_CRYPTO_DOWNLINK
+ * @param[in]  seq      frame counter
+ * @param[out] out      result, may be @p buf
+ */
+void lora_crypto_payload_encrypt(const uint8_t *buf, size_t size,
+                                 const uint8_t key[LORA_AES_KEY_SIZE],
+                                 uint32_t address, uint8_t dir, uint32_t seq,
+                                 uint8_t *out);
+
+/**
+ * @brief   Check a backend against the FIPS-197, RFC 4493 and LoRaWAN
+ *          test vectors
+ *
+ * Doesn't touch the backend in use, so it can run while the MAC thread
+ * encrypts.
+ *
+ * @return  0 if all vectors pass
+ * @return  -ENOTSUP if the backend is not available
+ * @return  the negative number of the first failing vector otherwise
+ */
+int lora_crypto_selftest(lora_crypto_backend_t backend);
+
+/**
+ * @brief   Print the cost per block of all available backends
+ *
+ * Cycles are read from the CCOUNT register on the ESP32, on other CPUs
+ * only the time per block is printed.
+ */
+void lora_crypto_bench(unsigned blocks);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LORA_CRYPTO_H */
+/** @} */
@@ -0,0 +1,441 @@
+/*
+ * Copyright (C) 2018 fcgdam
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @ingroup     ttgo_lora_crypto
+ * @{
+ *
+ * @file
+ * @brief       Backend selection, CMAC, LoRaWAN helpers, self test and
+ *              benchmark
+ *
+ * @author      fcgdam <primalcortex.wordpress.com>
+ * @}
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "xtimer.h"
+
+#include "lora_crypto.h"
+
+#define ENABLE_DEBUG (0)
+#include "debug.h"
+
+static lora_crypto_backend_t _backend = LORA_CRYPTO_SW;
+#ifdef LORA_CRYPTO_HAVE_HW
+/* the peripheral passed the self test since the last boot */
+static uint8_t _hw_ok;
+
+static int _selftest(lora_crypto_backend_t backend);
+
+static void _hw_check(void)
+{
+    lora_aes_hw_init();
+    _hw_ok = (_selftest(LORA_CRYPTO_HW) == 0);
+    if (!_hw_ok) {
+        DEBUG("lora_crypto: AES peripheral failed the self test\n");
+    }
+}
+#endif
+
+void lora_crypto_init(void)
+{
+#ifdef LORA_CRYPTO_HAVE_HW
+    _hw_check();
+    _backend = _hw_ok ? LORA_CRYPTO_HW : LORA_CRYPTO_SW;
+#else
+    _backend = LORA_CRYPTO_SW;
+#endif
+}
+
+void lora_crypto_resume(lora_crypto_backend_t backend)
+{
+#ifdef LORA_CRYPTO_HAVE_HW
+    if (backend == LORA_CRYPTO_HW) {
+        /* the peripheral clock is gated in deep sleep, and the retained
+           choice is no proof that it still works */
+        _hw_check();
+        _backend = _hw_ok ? LORA_CRYPTO_HW : LORA_CRYPTO_SW;
+        return;
+    }
+#else
+    (void)backend;
+#endif
+    _backend = LORA_CRYPTO_SW;
+}
+
+int lora_crypto_set_backend(lora_crypto_backend_t backend)
+{
+    if (backend == LORA_CRYPTO_HW) {
+#ifdef LORA_CRYPTO_HAVE_HW
+        if (!_hw_ok) {
+            return -EIO;
+        }
+#else
+        return -ENOTSUP;
+#endif
+    }
+    _backend = backend;
+    return 0;
+}
+
+lora_crypto_backend_t lora_crypto_get_backend(void)
+{
+    return _backend;
+}
+
+static inline void _encrypt(lora_crypto_backend_t backend,
+                            const lora_aes_ctx_t *ctx,
+                            const uint8_t *in, uint8_t *out)
+{
+#ifdef LORA_CRYPTO_HAVE_HW
+    if (backend == LORA_CRYPTO_HW) {
+        lora_aes_hw_encrypt(ctx, in, out);
+        return;
+    }
+#else
+    (void)backend;
+#endif
+    lora_aes_sw_encrypt(ctx, in, out);
+}
+
+void lora_aes_encrypt(const lora_aes_ctx_t *ctx,
+                      const uint8_t in[LORA_AES_BLOCK_SIZE],
+                      uint8_t out[LORA_AES_BLOCK_SIZE])
+{
+    _encrypt(_backend, ctx, in, out);
+}
+
+static void _xor_block(uint8_t *dst, const uint8_t *src)
+{
+    for (unsigned i = 0; i < LORA_AES_BLOCK_SIZE; i++) {
+        dst[i] ^= src[i];
+    }
+}
+
+/* doubling in GF(2^128) for the CMAC subkeys */
+static void _dbl(uint8_t *b)
+{
+    uint8_t carry = b[0] & 0x80;
+
+    for (unsigned i = 0; i < LORA_AES_BLOCK_SIZE - 1; i++) {
+        b[i] = (b[i] << 1) | (b[i + 1] >> 7);
+    }
+    b[LORA_AES_BLOCK_SIZE - 1] <<= 1;
+    if (carry) {
+        b[LORA_AES_BLOCK_SIZE - 1] ^= 0x87;
+    }
+}
+
+/* The CMAC and LoRaWAN functions take the backend as a parameter, so the
+   self test of one backend doesn't change the one the MAC thread uses */
+static void _cmac_update(lora_crypto_backend_t backend,
+                         const lora_aes_ctx_t *aes, uint8_t x[16],
+                         uint8_t last[16], uint32_t *n,
+                         const uint8_t *data, size_t len)
+{
+    while (len) {
+        if (*n == LORA_AES_BLOCK_SIZE) {
+            /* more data follows, so the kept block is not the last one */
+            _xor_block(x, last);
+            _encrypt(backend, aes, x, x);
+            *n = 0;
+        }
+        size_t chunk = LORA_AES_BLOCK_SIZE - *n;
+        if (chunk > len) {
+            chunk = len;
+        }
+        memcpy(&last[*n], data, chunk);
+        *n += chunk;
+        data += chunk;
+        len -= chunk;
+    }
+}
+
+static void _cmac_final(lora_crypto_backend_t backend,
+                        const lora_aes_ctx_t *aes, const uint8_t x[16],
+                        uint8_t last[16], uint32_t n, uint8_t mac[16])
+{
+    uint8_t k[LORA_AES_BLOCK_SIZE] = { 0 };
+
+    _encrypt(backend, aes, k, k);
+    _dbl(k);
+    if (n < LORA_AES_BLOCK_SIZE) {
+        _dbl(k);
+        last[n] = 0x80;
+        memset(&last[n + 1], 0, LORA_AES_BLOCK_SIZE - n - 1);
+    }
+
+    memcpy(mac, x, LORA_AES_BLOCK_SIZE);
+    _xor_block(mac, last);
+    _xor_block(mac, k);
+    _encrypt(backend, aes, mac, mac);
+}
+
+void lora_cmac_update_raw(const lora_aes_ctx_t *aes, uint8_t x[16],
+                          uint8_t last[16], uint32_t *n,
+                          const uint8_t *data, size_t len)
+{
+    _cmac_update(_backend, aes, x, last, n, data, len);
+}
+
+void lora_cmac_final_raw(const lora_aes_ctx_t *aes, const uint8_t x[16],
+                         uint8_t last[16], uint32_t n, uint8_t mac[16])
+{
+    _cmac_final(_backend, aes, x, last, n, mac);
+}
+
+void lora_cmac_init(lora_cmac_t *ctx, const uint8_t key[LORA_AES_KEY_SIZE])
+{
+    lora_aes_setkey(&ctx->aes, key);
+    memset(ctx->x, 0, sizeof(ctx->x));
+    ctx->n = 0;
+}
+
+void lora_cmac_update(lora_cmac_t *ctx, const uint8_t *data, size_t len)
+{
+    lora_cmac_update_raw(&ctx->aes, ctx->x, ctx->last, &ctx->n, data, len);
+}
+
+void lora_cmac_final(lora_cmac_t *ctx, uint8_t mac[LORA_AES_BLOCK_SIZE])
+{
+    lora_cmac_final_raw(&ctx->aes, ctx->x, ctx->last, ctx->n, mac);
+}
+
+/* B0 and Ai blocks of LoRaWAN 1.0, section 4.3.3 and 4.4 */
+static void _lorawan_block(uint8_t *b, uint8_t type, uint32_t address,
+                           uint8_t dir, uint32_t seq, uint8_t last)
+{
+    b[0] = type;
+    b[1] = b[2] = b[3] = b[4] = 0;
+    b[5] = dir;
+    b[6] = address;
+    b[7] = address >> 8;
+    b[8] = address >> 16;
+    b[9] = address >> 24;
+    b[10] = seq;
+    b[11] = seq >> 8;
+    b[12] = seq >> 16;
+    b[13] = seq >> 24;
+    b[14] = 0;
+    b[15] = last;
+}
+
+static uint32_t _compute_mic(lora_crypto_backend_t backend,
+                             const uint8_t *buf, size_t size,
+                             const uint8_t key[LORA_AES_KEY_SIZE],
+                             uint32_t address, uint8_t dir, uint32_t seq)
+{
+    lora_cmac_t cmac;
+    uint8_t b[LORA_AES_BLOCK_SIZE];
+
+    _lorawan_block(b, 0x49, address, dir, seq, (uint8_t)size);
+    lora_cmac_init(&cmac, key);
+    _cmac_update(backend, &cmac.aes, cmac.x, cmac.last, &cmac.n, b, sizeof(b));
+    _cmac_update(backend, &cmac.aes, cmac.x, cmac.last, &cmac.n, buf, size);
+    _cmac_final(backend, &cmac.aes, cmac.x, cmac.last, cmac.n, b);
+
+    return (uint32_t)b[0] | ((uint32_t)b[1] << 8) |
+           ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+uint32_t lora_crypto_compute_mic(const uint8_t *buf, size_t size,
+                                 const uint8_t key[LORA_AES_KEY_SIZE],
+                                 uint32_t address, uint8_t dir, uint32_t seq)
+{
+    return _compute_mic(_backend, buf, size, key, address, dir, seq);
+}
+
+static void _payload_encrypt(lora_crypto_backend_t backend,
+                             const uint8_t *buf, size_t size,
+                             const uint8_t key[LORA_AES_KEY_SIZE],
+                             uint32_t address, uint8_t dir, uint32_t seq,
+                             uint8_t *out)
+{
+    lora_aes_ctx_t aes;
+    uint8_t a[LORA_AES_BLOCK_SIZE];
+    uint8_t s[LORA_AES_BLOCK_SIZE];
+    uint8_t ctr = 1;
+
+    lora_aes_setkey(&aes, key);
+    while (size) {
+        size_t chunk = (size < LORA_AES_BLOCK_SIZE) ? size : LORA_AES_BLOCK_SIZE;
+
+        _lorawan_block(a, 0x01, address, dir, seq, ctr++);
+        _encrypt(backend, &aes, a, s);
+        for (size_t i = 0; i < chunk; i++) {
+            out[i] = buf[i] ^ s[i];
+        }
+        buf += chunk;
+        out += chunk;
+        size -= chunk;
+    }
+}
+
+void lora_crypto_payload_encrypt(const uint8_t *buf, size_t size,
+                                 const uint8_t key[LORA_AES_KEY_SIZE],
+                                 uint32_t address, uint8_t dir, uint32_t seq,
+                                 uint8_t *out)
+{
+    _payload_encrypt(_backend, buf, size, key, address, dir, seq, out);
+}
+
+/* FIPS-197 appendix C.1 */
+static const uint8_t _fips_key[] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+};
+static const uint8_t _fips_pt[] = {
+    0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+    0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+};
+static const uint8_t _fips_ct[] = {
+    0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+    0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a
+};
+
+/* RFC 4493 section 4, examples 1 to 3 */
+static const uint8_t _rfc_key[] = {
+    0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+    0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c
+};
+static const uint8_t _rfc_msg[] = {
+    0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96,
+    0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+    0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c,
+    0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+    0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11
+};
+static const struct {
+    uint8_t len;
+    uint8_t mac[LORA_AES_BLOCK_SIZE];
+} _rfc_vectors[] = {
+    { 0, { 0xbb, 0x1d, 0x69, 0x29, 0xe9, 0x59, 0x37, 0x28,
+           0x7f, 0xa3, 0x7d, 0x12, 0x9b, 0x75, 0x67, 0x46 } },
+    { 16, { 0x07, 0x0a, 0x16, 0xb4, 0x6b, 0x4d, 0x41, 0x44,
+            0xf7, 0x9b, 0xdd, 0x9d, 0xd0, 0x4a, 0x28, 0x7c } },
+    { 40, { 0xdf, 0xa6, 0x67, 0x47, 0xde, 0x9a, 0xe6, 0x30,
+            0x30, 0xca, 0x32, 0x61, 0x14, 0x97, 0xc8, 0x27 } },
+};
+
+/* LoRaWAN 1.0 unconfirmed uplink "test" on port 1, FCnt 2, from the
+ * lora-packet reference: 40 F17DBE49 00 0200 01 95437876 2B11FF0D */
+static const uint8_t _lw_nwkskey[] = {
+    0x44, 0x02, 0x42, 0x41, 0xed, 0x4c, 0xe9, 0xa6,
+    0x8c, 0x6a, 0x8b, 0xc0, 0x55, 0x23, 0x3f, 0xd3
+};
+static const uint8_t _lw_appskey[] = {
+    0xec, 0x92, 0x58, 0x02, 0xae, 0x43, 0x0c, 0xa7,
+    0x7f, 0xd3, 0xdd, 0x73, 0xcb, 0x2c, 0xc5, 0x88
+};
+static const uint8_t _lw_frame[] = {
+    0x40, 0xf1, 0x7d, 0xbe, 0x49, 0x00, 0x02, 0x00,
+    0x01, 0x95, 0x43, 0x78, 0x76
+};
+#define LW_DEVADDR      (0x49be7df1UL)
+#define LW_FCNT         (2U)
+#define LW_MIC          (0x0dff112bUL)
+
+static int _selftest(lora_crypto_backend_t backend)
+{
+    lora_aes_ctx_t aes;
+    lora_cmac_t cmac;
+    uint8_t buf[LORA_AES_BLOCK_SIZE];
+
+    lora_aes_setkey(&aes, _fips_key);
+    _encrypt(backend, &aes, _fips_pt, buf);
+    if (memcmp(buf, _fips_ct, sizeof(buf))) {
+        return -1;
+    }
+
+    for (unsigned i = 0; i < sizeof(_rfc_vectors) / sizeof(_rfc_vectors[0]); i++) {
+        size_t part = _rfc_vectors[i].len / 3;
+
+        lora_cmac_init(&cmac, _rfc_key);
+        /* feed in two parts to exercise the block buffering */
+        _cmac_update(backend, &cmac.aes, cmac.x, cmac.last, &cmac.n,
+                     _rfc_msg, part);
+        _cmac_update(backend, &cmac.aes, cmac.x, cmac.last, &cmac.n,
+                     _rfc_msg + part, _rfc_vectors[i].len - part);
+        _cmac_final(backend, &cmac.aes, cmac.x, cmac.last, cmac.n, buf);
+        if (memcmp(buf, _rfc_vectors[i].mac, sizeof(buf))) {
+            return -2 - i;
+        }
+    }
+
+    if (_compute_mic(backend, _lw_frame, sizeof(_lw_frame), _lw_nwkskey,
+                     LW_DEVADDR, LORA_CRYPTO_UPLINK, LW_FCNT) != LW_MIC) {
+        return -5;
+    }
+    _payload_encrypt(backend, &_lw_frame[9], 4, _lw_appskey, LW_DEVADDR,
+                     LORA_CRYPTO_UPLINK, LW_FCNT, buf);
+    if (memcmp(buf, "test", 4)) {
+        return -6;
+    }
+    return 0;
+}
+
+int lora_crypto_selftest(lora_crypto_backend_t backend)
+{
+#ifndef LORA_CRYPTO_HAVE_HW
+    if (backend == LORA_CRYPTO_HW) {
+        return -ENOTSUP;
+    }
+#endif
+    return _selftest(backend);
+}
+
+static inline uint32_t _cycles(void)
+{
+#ifdef CPU_ESP32
+    uint32_t ccount;
+    __asm__ volatile ("rsr %0, ccount" : "=a" (ccount));
+    return ccount;
+#else
+    return 0;
+#endif
+}
+
+static void _bench(const char *name, lora_crypto_backend_t backend,
+                   unsigned blocks)
+{
+    lora_aes_ctx_t aes;
+    uint8_t block[LORA_AES_BLOCK_SIZE];
+
+    memcpy(block, _fips_pt, sizeof(block));
+    lora_aes_setkey(&aes, _fips_key);
+
+    uint32_t c_start = _cycles();
+    uint32_t t_start = xtimer_now_usec();
+    for (unsigned i = 0; i < blocks; i++) {
+        _encrypt(backend, &aes, block, block);
+    }
+    uint32_t t = xtimer_now_usec() - t_start;
+    uint32_t c = _cycles() - c_start;
+
+    printf("%s: %u blocks in %lu us, %lu ns/block", name, blocks,
+           (unsigned long)t, (unsigned long)((t * 1000ULL) / blocks));
+    if (c) {
+        printf(", %lu cycles/block", (unsigned long)(c / blocks));
+    }
+    puts("");
+}
+
+void lora_crypto_bench(unsigned blocks)
+{
+    if (blocks == 0) {
+        return;
+    }
+    _bench("sw", LORA_CRYPTO_SW, blocks);
+#ifdef LORA_CRYPTO_HAVE_HW
+    _bench("hw", LORA_CRYPTO_HW, blocks);
+#endif
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2018 fcgdam
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @ingroup     ttgo_lora_crypto
+ * @{
+ *
+ * @file
+ * @brief       semtech-loramac crypto API on top of lora_crypto
+ *
+ * Implements the functions of the package's aes.h and cmac.h that
+ * LoRaMacCrypto.c uses. The contexts are the package's own structures, the
+ * lora_crypto key schedule is stored in their ksch[] array.
+ *
+ * @author      fcgdam <primalcortex.wordpress.com>
+ * @}
+ */
+
+#ifdef MODULE_SEMTECH_LORAMAC
+
+#include <string.h>
+
+#include "aes.h"
+#include "cmac.h"
+
+#include "lora_crypto.h"
+
+_Static_assert(sizeof(((aes_context *)0)->ksch) >= sizeof(lora_aes_ctx_t),
+               "aes_context too small for the lora_crypto key schedule");
+
+/* aes_context is a byte array, only use it in place when it is aligned */
+static const lora_aes_ctx_t *_ctx(const aes_context *ctx, lora_aes_ctx_t *tmp)
+{
+    if (((uintptr_t)ctx->ksch & (sizeof(uint32_t) - 1)) == 0) {
+        return (const lora_aes_ctx_t *)(uintptr_t)ctx->ksch;
+    }
+    memcpy(tmp, ctx->ksch, sizeof(*tmp));
+    return tmp;
+}
+
+return_type aes_set_key(const uint8_t key[], length_type keylen,
+                        aes_context ctx[1])
+{
+    lora_aes_ctx_t tmp;
+
+    if (keylen != LORA_AES_KEY_SIZE) {
+        ctx->rnd = 0;
+        return (return_type)-1;
+    }
+    lora_aes_setkey(&tmp, key);
+    memcpy(ctx->ksch, &tmp, sizeof(tmp));
+    ctx->rnd = 10;
+    return 0;
+}
+
+return_type aes_encrypt(const uint8_t in[N_BLOCK], uint8_t out[N_BLOCK],
+                        const aes_context ctx[1])
+{
+    lora_aes_ctx_t tmp;
+
+    if (ctx->rnd == 0) {
+        return (return_type)-1;
+    }
+    lora_aes_encrypt(_ctx(ctx, &tmp), in, out);
+    return 0;
+}
+
+void AES_CMAC_Init(AES_CMAC_CTX *ctx)
+{
+    memset(ctx->X, 0, sizeof(ctx->X));
+    ctx->M_n = 0;
+}
+
+void AES_CMAC_SetKey(AES_CMAC_CTX *ctx, const uint8_t key[AES_CMAC_KEY_LENGTH])
+{
+    aes_set_key(key, AES_CMAC_KEY_LENGTH, &ctx->rijndael);
+}
+
+void AES_CMAC_Update(AES_CMAC_CTX *ctx, const uint8_t *data, uint32_t len)
+{
+    lora_aes_ctx_t tmp;
+    uint32_t n = ctx->M_n;
+
+    lora_cmac_update_raw(_ctx(&ctx->rijndael, &tmp), ctx->X, ctx->M_last,
+                         &n, data, len);
+    ctx->M_n = n;
+}
+
+void AES_CMAC_Final(uint8_t digest[AES_CMAC_DIGEST_LENGTH], AES_CMAC_CTX *ctx)
+{
+    lora_aes_ctx_t tmp;
+
+    lora_cmac_final_raw(_ctx(&ctx->rijndael, &tmp), ctx->X, ctx->M_last,
+                        ctx->M_n, digest);
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+#else
+typedef int dont_be_pedantic;
+#endif /* MODULE_SEMTECH_LORAMAC */
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2018 fcgdam
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @defgroup    ttgo_profiler Sampling CPU profiler
+ * @ingroup     boards_esp32_TTGO_LORA_V1
+ * @brief       Statistical profile of where the CPU time goes
+ *
+ * While running, an xtimer interrupt fires at the sampling rate and
+ * stores the program counter of the code it interrupted together with the
+ * active thread into a buffer. Sampling stops when the buffer is full. The
+ * period is jittered by up to +-25% so that periodic code (xtimer driven
+ * loops, the LoRaMAC timers) is not sampled in lock step. No period is
+ * shorter than @ref PROFILER_MIN_PERIOD_US: the timer is re-armed from its
+ * own callback, and xtimer_set() spins in the interrupt instead of arming
+ * the timer for offsets close to XTIMER_BACKOFF.
+ *
+ * The interrupted PC is read from the context the CPU port saved on
+ * interrupt entry:
+ * - ESP32: the exception frame (XtExcFrame) the interrupt entry stores at
+ *   the stack pointer of the active thread
+ * - native: the PC the signal handler saved in _native_saved_eip
+ *
+ * profiler_dump() prints the samples as text between "PROF begin" and
+ * "PROF end" lines. dist/tools/profiler/symbolize.py reads them from a
+ * terminal log and turns them into a flat profile or a flame graph with the
+ * symbols of the application ELF file.
+ *
+ * @{
+ *
+ * @file
+ * @author      fcgdam <primalcortex.wordpress.com>
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+
+#include "kernel_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief   Number of samples in the buffer (8 bytes each)
+ */
+#ifndef PROFILER_SAMPLES
+#define PROFILER_SAMPLES        (2048U)
+#endif
+
+/**
+ * @brief   Sampling rate used when none is given, in Hz
+ */
+#ifndef PROFILER_DEFAULT_HZ
+#define PROFILER_DEFAULT_HZ     (1000U)
+#endif
+
+/**
+ * @brief   Highest sampling rate accepted, in Hz
+ *
+ * With the jitter its shortest period is 375 us.
+ */
+#ifndef PROFILER_MAX_HZ
+#define PROFILER_MAX_HZ         (2000U)
+#endif
+
+/**
+ * @brief   Shortest time between two samples, in us
+ *
+ * A jittered period below it is raised to it. Has to stay well above
+ * XTIMER_BACKOFF, the build fails below four times it (1 MHz xtimer).
+ */
+#ifndef PROFILER_MIN_PERIOD_US
+#define PROFILER_MIN_PERIOD_US  (250U)
+#endif
+
+/**
+ * @brief   One sample
+ */
+typedef struct {
+    uintptr_t pc;               /**< interrupted program counter */
+    kernel_pid_t pid;           /**< thread that was running */
+} profiler_sample_t;
+
+/**
+ * @brief   Clear the buffer and start sampling
+ *
+ * @param[in] hz    sampling rate, 0 for @ref PROFILER_DEFAULT_HZ
+ *
+ * @return  0 on success
+ * @return  -EINVAL if hz is above @ref PROFILER_MAX_HZ
+ */
+int profiler_start(unsigned hz);
+
+/**
+ * @brief   Stop sampling, the samples stay in the buffer
+ */
+void profiler_stop(void);
+
+/**
+ * @brief   Number of samples in the buffer
+ */
+unsigned profiler_count(void);
+
+/**
+ * @brief   Print the samples for dist/tools/profiler/symbolize.py
+ *
+ * Sampling is stopped first.
+ */
+void profiler_dump(void);
+
+/**
+ * @brief   Shell command handler: prof [start [hz] | stop | dump]
+ *
+ * Without arguments it prints the state and number of samples. Add it to
+ * the application's shell_commands, e.g. { "prof", "...", profiler_cmd }.
+ */
+int profiler_cmd(int argc, char **argv);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PROFILER_H */
+/** @} */
@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2018 fcgdam
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @ingroup     ttgo_profiler
+ * @{
+ *
+ * @file
+ * @brief       Sampling CPU profiler implementation
+ *
+ * @author      fcgdam <primalcortex.wordpress.com>
+ * @}
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "irq.h"
+#include "sched.h"
+#include "thread.h"
+#include "xtimer.h"
+
+#include "profiler.h"
+
+#if defined(CPU_NATIVE)
+#include "native_internal.h"
+#elif defined(CPU_ESP32)
+#include "xtensa/xtensa_context.h"
+#else
+#error "profiler: reading the interrupted PC is not implemented for this CPU"
+#endif
+
+#if (XTIMER_HZ == 1000000UL) && (PROFILER_MIN_PERIOD_US < 4 * XTIMER_BACKOFF)
+#error "profiler: PROFILER_MIN_PERIOD_US too close to XTIMER_BACKOFF"
+#endif
+
+#define ENABLE_DEBUG (0)
+#include "debug.h"
+
+static profiler_sample_t _samples[PROFILER_SAMPLES];
+static volatile unsigned _count;
+static volatile uint8_t _running;
+static uint32_t _period;
+static uint32_t _rand = 0x2545f491;
+static uint32_t _started;
+static uint32_t _elapsed;
+static xtimer_t _timer;
+
+static inline uintptr_t _interrupted_pc(void)
+{
+#if defined(CPU_NATIVE)
+    /* native_isr_entry() saved the PC of the interrupted thread before
+     * redirecting it to the ISR trampoline */
+    return (uintptr_t)_native_saved_eip;
+#else
+    /* _frxt_int_enter() stored the interrupted context as an exception
+     * frame and its address as the stack pointer of the active thread */
+    return ((XtExcFrame *)sched_active_thread->sp)->pc;
+#endif
+}
+
+static uint32_t _next_period(void)
+{
+    /* xorshift32, uniform jitter of +-25% of the period */
+    _rand ^= _rand << 13;
+    _rand ^= _rand >> 17;
+    _rand ^= _rand << 5;
+    uint32_t span = _period / 2;
+    uint32_t period = _period - (span / 2) + (span ? (_rand % span) : 0);
+
+    return (period < PROFILER_MIN_PERIOD_US) ? PROFILER_MIN_PERIOD_US : period;
+}
+
+static void _sample(void *arg)
+{
+    (void)arg;
+
+    if (!_running) {
+        return;
+    }
+    if (_count >= PROFILER_SAMPLES) {
+        _running = 0;
+        _elapsed = xtimer_now_usec() - _started;
+        return;
+    }
+    _samples[_count].pc = _interrupted_pc();
+    _samples[_count].pid = sched_active_pid;
+    _count++;
+    xtimer_set(&_timer, _next_period());
+}
+
+int profiler_start(unsigned hz)
+{
+    if (hz == 0) {
+        hz = PROFILER_DEFAULT_HZ;
+    }
+    if (hz > PROFILER_MAX_HZ) {
+        return -EINVAL;
+    }
+
+    profiler_stop();
+    _count = 0;
+    _period = US_PER_SEC / hz;
+    _timer.callback = _sample;
+    _timer.arg = NULL;
+    _started = xtimer_now_usec();
+    _running = 1;
+    xtimer_set(&_timer, _next_period());
+    return 0;
+}
+
+void profiler_stop(void)
+{
+    unsigned state = irq_disable();
+
+    if (_running) {
+        _running = 0;
+        _elapsed = xtimer_now_usec() - _started;
+    }
+    irq_restore(state);
+    xtimer_remove(&_timer);
+}
+
+unsigned profiler_count(void)
+{
+    return _count;
+}
+
+void profiler_dump(void)
+{
+    uint8_t seen[KERNEL_PID_LAST + 1];
+
+    profiler_stop();
+    memset(seen, 0, sizeof(seen));
+
+    /* the base lets the host relocate the PCs of a position independent
+     * native build */
+    printf("PROF begin samples=%u period_us=%" PRIu32 " elapsed_us=%" PRIu32
+           " base=%" PRIxPTR "\n", _count, _period, _elapsed,
+           (uintptr_t)&profiler_dump);
+    for (unsigned i = 0; i < _count; i++) {
+        kernel_pid_t pid = _samples[i].pid;
+
+        if (pid >= 0 && pid <= KERNEL_PID_LAST && !seen[pid]) {
+            const char *name = thread_getname(pid);
+
+            printf("PROF thread %d %s\n", (int)pid, name ? name : "?");
+            seen[pid] = 1;
+        }
+    }
+    for (unsigned i = 0; i < _count; i++) {
+        printf("%" PRIxPTR " %d\n", _samples[i].pc, (int)_samples[i].pid);
+    }
+    puts("PROF end");
+}
+
+int profiler_cmd(int argc, char **argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "start") == 0) {
+        unsigned hz = (argc > 2) ? (unsigned)atoi(argv[2]) : 0;
+
+        if (profiler_start(hz) < 0) {
+            printf("prof: rate above %u Hz\n", PROFILER_MAX_HZ);
+            return 1;
+        }
+        printf("prof: sampling at %u Hz, stops after %u samples\n",
+               hz ? hz : PROFILER_DEFAULT_HZ, PROFILER_SAMPLES);
+        return 0;
+    }
+    if (argc == 2 && strcmp(argv[1], "stop") == 0) {
+        profiler_stop();
+        printf("prof: %u samples\n", _count);
+        return 0;
+    }
+    if (argc == 2 && strcmp(argv[1], "dump") == 0) {
+        profiler_dump();
+        return 0;
+    }
+    if (argc == 1) {
+        printf("prof: %s, %u/%u samples\n", _running ? "running" : "stopped",
+               _count, PROFILER_SAMPLES);
+        return 0;
+    }
+    puts("Usage: prof [start [hz] | stop | dump]");
+    return 1;
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2018 fcgdam
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @defgroup    ttgo_rtc_retain State retention across deep sleep
+ * @ingroup     boards_esp32_TTGO_LORA_V1
+ * @brief       Application state kept in RTC memory for a fast resume
+ *
+ * In deep sleep the ESP32 powers down the CPUs and the main RAM, only the
+ * RTC domain stays on. Waking up is a reset: the bootloader loads the
+ * image again and RIOT starts from scratch. This module keeps one block of
+ * application state in RTC slow memory, so the application can tell a
+ * wake up from deep sleep from a cold boot and continue where it stopped
+ * instead of initializing everything again.
+ *
+ * The block is only handed back when the reset was a deep sleep wake up
+ * started by rtc_retain_sleep() and its size and CRC match, anything else
+ * (power on, reset button, crash, a different firmware layout) counts as a
+ * cold boot.
+ *
+ * On native there is no RTC memory. rtc_retain_sleep() writes the block
+ * to the file @ref RTC_RETAIN_NATIVE_FILE and restarts the process with
+ * pm_reboot(), the next start reads the file back and removes its
+ * content. This simulated reset exercises the same restore path as the
+ * board, without the sleep time.
+ *
+ * @{
+ *
+ * @file
+ * @author      fcgdam <primalcortex.wordpress.com>
+ */
+
+#ifndef RTC_RETAIN_H
+#define RTC_RETAIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief   Maximum size of the application state in bytes
+ */
+#ifndef RTC_RETAIN_SIZE
+#define RTC_RETAIN_SIZE         (512U)
+#endif
+
+/**
+ * @brief   File standing in for the RTC memory on native
+ */
+#ifndef RTC_RETAIN_NATIVE_FILE
+#define RTC_RETAIN_NATIVE_FILE  "rtc_retain.bin"
+#endif
+
+/**
+ * @brief   How the system came up
+ */
+typedef enum {
+    RTC_RETAIN_COLD,            /**< no retained state */
+    RTC_RETAIN_WARM,            /**< woken up by rtc_retain_sleep() */
+    RTC_RETAIN_INVALID,         /**< woken up, but the state failed the
+                                     size or CRC check */
+} rtc_retain_boot_t;
+
+/**
+ * @brief   Counters kept with the state
+ */
+typedef struct {
+    uint32_t wakes;             /**< warm resumes since the last cold boot */
+    uint32_t slept_ms;          /**< requested sleep time since then */
+    uint32_t last_awake_us;     /**< time awake before the last sleep */
+} rtc_retain_info_t;
+
+/**
+ * @brief   Check the retained state, once per boot
+ */
+rtc_retain_boot_t rtc_retain_boot(void);
+
+/**
+ * @brief   Copy the retained state out
+ *
+ * @param[out] state    application state
+ * @param[in]  size     size of @p state
+ *
+ * @return  0 after a wake up from rtc_retain_sleep()
+ * @return  -ENOENT on a cold boot
+ * @return  -EINVAL if the state did not pass the check or has another size
+ */
+int rtc_retain_restore(void *state, size_t size);
+
+/**
+ * @brief   Store the application state in RTC memory
+ *
+ * @param[in] state     application state
+ * @param[in] size      size of @p state, at most @ref RTC_RETAIN_SIZE
+ *
+ * @return  0 on success
+ * @return  -EINVAL if @p size is too large
+ */
+int rtc_retain_save(const void *state, size_t size);
+
+/**
+ * @brief   Drop the retained state, the next boot is a cold one
+ */
+void rtc_retain_clear(void);
+
+/**
+ * @brief   Enter deep sleep, the state saved last is kept
+ *
+ * @param[in] usec      sleep time in microseconds
+ */
+void rtc_retain_sleep(uint32_t usec) __attribute__((noreturn));
+
+/**
+ * @brief   Get the counters
+ */
+void rtc_retain_get_info(rtc_retain_info_t *info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RTC_RETAIN_H */
+/** @} */
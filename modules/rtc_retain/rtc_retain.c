@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2018 fcgdam
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @ingroup     ttgo_rtc_retain
+ * @{
+ *
+ * @file
+ * @brief       State retention across deep sleep implementation
+ *
+ * @author      fcgdam <primalcortex.wordpress.com>
+ * @}
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "checksum/crc16_ccitt.h"
+#include "xtimer.h"
+
+#include "rtc_retain.h"
+
+#if defined(CPU_NATIVE)
+#include "native_internal.h"
+#include "periph/pm.h"
+#define RTC_RETAIN_ATTR
+#elif defined(CPU_ESP32)
+#include "esp_attr.h"
+#include "esp_sleep.h"
+#include "rom/rtc.h"
+#include "rom/uart.h"
+/* loaded by the bootloader on a cold boot, left alone on a deep sleep
+ * wake up */
+#define RTC_RETAIN_ATTR         RTC_DATA_ATTR
+#else
+#error "rtc_retain: deep sleep is not implemented for this CPU"
+#endif
+
+#define ENABLE_DEBUG (0)
+#include "debug.h"
+
+#define RTC_RETAIN_MAGIC        (0x52544352UL)  /* "RTCR" */
+#define RTC_RETAIN_SLEEPING     (0x0001)
+
+typedef struct {
+    uint32_t magic;
+    uint16_t size;              /* of the application state */
+    uint16_t flags;
+    uint16_t crc;               /* over info and the application state */
+    uint16_t reserved;
+    rtc_retain_info_t info;
+    uint8_t data[RTC_RETAIN_SIZE];
+} rtc_retain_area_t;
+
+static RTC_RETAIN_ATTR rtc_retain_area_t _area;
+static uint8_t _checked;
+static rtc_retain_boot_t _boot;
+
+static uint16_t _crc(void)
+{
+    uint16_t crc = crc16_ccitt_calc((const uint8_t *)&_area.info,
+                                    sizeof(_area.info));
+
+    return crc16_ccitt_update(crc, _area.data, _area.size);
+}
+
+#if defined(CPU_NATIVE)
+static void _load(void)
+{
+    FILE *f = real_fopen(RTC_RETAIN_NATIVE_FILE, "rb");
+
+    memset(&_area, 0, sizeof(_area));
+    if (f == NULL) {
+        return;
+    }
+    if (real_fread(&_area, sizeof(_area), 1, f) != 1) {
+        memset(&_area, 0, sizeof(_area));
+    }
+    real_fclose(f);
+
+    /* one resume per sleep, like the RTC memory after a power cycle */
+    f = real_fopen(RTC_RETAIN_NATIVE_FILE, "wb");
+    if (f) {
+        real_fclose(f);
+    }
+}
+
+static int _woken_up(void)
+{
+    return 1;
+}
+
+static void _enter_sleep(uint32_t usec)
+{
+    FILE *f = real_fopen(RTC_RETAIN_NATIVE_FILE, "wb");
+
+    (void)usec;
+    if (f == NULL || real_fwrite(&_area, sizeof(_area), 1, f) != 1) {
+        printf("rtc_retain: cannot write %s\n", RTC_RETAIN_NATIVE_FILE);
+    }
+    if (f) {
+        real_fclose(f);
+    }
+    /* the simulated reset, the sleep time is skipped */
+    pm_reboot();
+}
+#else
+static void _load(void)
+{
+}
+
+static int _woken_up(void)
+{
+    return rtc_get_reset_reason(0) == DEEPSLEEP_RESET;
+}
+
+static void _enter_sleep(uint32_t usec)
+{
+    /* let the UART send what is still in its FIFO */
+    uart_tx_wait_idle(0);
+    esp_sleep_enable_timer_wakeup(usec);
+    esp_deep_sleep_start();
+}
+#endif
+
+rtc_retain_boot_t rtc_retain_boot(void)
+{
+    if (_checked) {
+        return _boot;
+    }
+    _checked = 1;
+    _load();
+
+    if (!_woken_up() || _area.magic != RTC_RETAIN_MAGIC ||
+        !(_area.flags & RTC_RETAIN_SLEEPING)) {
+        _boot = RTC_RETAIN_COLD;
+    }
+    else if (_area.size > RTC_RETAIN_SIZE || _area.crc != _crc()) {
+        _boot = RTC_RETAIN_INVALID;
+    }
+    else {
+        _boot = RTC_RETAIN_WARM;
+    }
+    DEBUG("rtc_retain: boot %d\n", (int)_boot);
+
+    if (_boot == RTC_RETAIN_WARM) {
+        _area.info.wakes++;
+    }
+    else {
+        memset(&_area, 0, sizeof(_area));
+    }
+    _area.flags &= ~RTC_RETAIN_SLEEPING;
+    return _boot;
+}
+
+int rtc_retain_restore(void *state, size_t size)
+{
+    switch (rtc_retain_boot()) {
+        case RTC_RETAIN_COLD:
+            return -ENOENT;
+        case RTC_RETAIN_INVALID:
+            return -EINVAL;
+        default:
+            break;
+    }
+    if (_area.size != size) {
+        return -EINVAL;
+    }
+    memcpy(state, _area.data, size);
+    return 0;
+}
+
+int rtc_retain_save(const void *state, size_t size)
+{
+    if (size > RTC_RETAIN_SIZE) {
+        return -EINVAL;
+    }
+    rtc_retain_boot();
+
+    memcpy(_area.data, state, size);
+    _area.size = size;
+    _area.magic = RTC_RETAIN_MAGIC;
+    return 0;
+}
+
+void rtc_retain_clear(void)
+{
+    rtc_retain_boot();
+    memset(&_area, 0, sizeof(_area));
+}
+
+void rtc_retain_sleep(uint32_t usec)
+{
+    rtc_retain_boot();
+
+    _area.magic = RTC_RETAIN_MAGIC;
+    _area.info.slept_ms += usec / 1000;
+    _area.info.last_awake_us = xtimer_now_usec();
+    _area.flags |= RTC_RETAIN_SLEEPING;
+    _area.crc = _crc();
+    DEBUG("rtc_retain: sleep %lu us\n", (unsigned long)usec);
+
+    _enter_sleep(usec);
+    while (1) {}
+}
+
+void rtc_retain_get_info(rtc_retain_info_t *info)
+{
+    rtc_retain_boot();
+    *info = _area.info;
+}
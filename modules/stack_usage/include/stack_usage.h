@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2018 fcgdam
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @defgroup    ttgo_stack_usage Thread stack high-water marks
+ * @ingroup     boards_esp32_TTGO_LORA_V1
+ * @brief       Per thread stack usage and message queue report
+ *
+ * Threads created with THREAD_CREATE_STACKTEST (main and idle always are)
+ * get their stack painted at creation: every word holds its own address.
+ * The high-water mark of a thread is the deepest word that no longer holds
+ * its address, so the report shows the worst case since the thread
+ * started, not just the current depth.
+ *
+ * stack_usage_repaint() paints the unused part of all stacks again, so
+ * that the next report only shows the usage of what ran in between (e.g.
+ * a LoRaWAN join, or a burst of shell commands).
+ *
+ * Stack start and size are only known to the kernel with DEVELHELP, without
+ * it the functions report nothing.
+ *
+ * @{
+ *
+ * @file
+ * @author      fcgdam <primalcortex.wordpress.com>
+ */
+
+#ifndef STACK_USAGE_H
+#define STACK_USAGE_H
+
+#include <stddef.h>
+
+#include "kernel_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief   Bytes left untouched by stack_usage_repaint() below the saved
+ *          stack pointer of a thread
+ *
+ * The ISR and the register window spill code of the ESP32 write below the
+ * stack pointer, so that area is never repainted.
+ */
+#ifndef STACK_USAGE_REPAINT_GUARD
+#define STACK_USAGE_REPAINT_GUARD   (256U)
+#endif
+
+/**
+ * @brief   Free stack below which stack_usage_print() flags a thread
+ */
+#ifndef STACK_USAGE_WARN_FREE
+#define STACK_USAGE_WARN_FREE       (256U)
+#endif
+
+/**
+ * @brief   Stack and message queue usage of one thread
+ */
+typedef struct {
+    const char *name;           /**< thread name */
+    size_t size;                /**< stack size in bytes */
+    size_t used;                /**< high-water mark in bytes */
+    unsigned queue_size;        /**< message queue entries, 0 if none */
+    unsigned queue_used;        /**< messages currently queued */
+} stack_usage_t;
+
+/**
+ * @brief   Get the stack usage of a thread
+ *
+ * @param[in]  pid      thread to look at
+ * @param[out] usage    stack and message queue usage
+ *
+ * @return  0 on success
+ * @return  -1 if there is no such thread or the build lacks DEVELHELP
+ */
+int stack_usage_get(kernel_pid_t pid, stack_usage_t *usage);
+
+/**
+ * @brief   Print the stack usage of all threads
+ *
+ * One line per thread with stack size, high-water mark, free bytes and
+ * message queue fill, then the total of stack bytes never used.
+ */
+void stack_usage_print(void);
+
+/**
+ * @brief   Paint the unused part of all thread stacks again
+ *
+ * Resets the high-water marks to the current depth of each thread (plus
+ * @ref STACK_USAGE_REPAINT_GUARD).
+ */
+void stack_usage_repaint(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STACK_USAGE_H */
+/** @} */
@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2018 fcgdam
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @ingroup     ttgo_stack_usage
+ * @{
+ *
+ * @file
+ * @brief       Thread stack high-water marks implementation
+ *
+ * @author      fcgdam <primalcortex.wordpress.com>
+ * @}
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cib.h"
+#include "irq.h"
+#include "sched.h"
+#include "thread.h"
+
+#include "stack_usage.h"
+
+#define ENABLE_DEBUG (0)
+#include "debug.h"
+
+#ifdef DEVELHELP
+
+int stack_usage_get(kernel_pid_t pid, stack_usage_t *usage)
+{
+    volatile thread_t *thread = thread_get(pid);
+
+    if (thread == NULL) {
+        return -1;
+    }
+
+    usage->name = thread->name;
+    usage->size = thread->stack_size;
+    usage->used = usage->size - thread_measure_stack_free(thread->stack_start);
+    usage->queue_size = 0;
+    usage->queue_used = 0;
+#ifdef MODULE_CORE_MSG
+    if (thread->msg_array != NULL) {
+        usage->queue_size = thread->msg_queue.mask + 1;
+        usage->queue_used = cib_avail((cib_t *)&thread->msg_queue);
+    }
+#endif
+    return 0;
+}
+
+void stack_usage_print(void)
+{
+    stack_usage_t u;
+    size_t total = 0;
+    size_t unused = 0;
+
+    puts(" pid name                 size  used  free  use queue");
+    for (kernel_pid_t pid = KERNEL_PID_FIRST; pid <= KERNEL_PID_LAST; pid++) {
+        if (stack_usage_get(pid, &u) < 0) {
+            continue;
+        }
+        size_t free = u.size - u.used;
+
+        printf("%4d %-18s %6u %5u %5u %3u%%", (int)pid, u.name,
+               (unsigned)u.size, (unsigned)u.used, (unsigned)free,
+               (unsigned)((u.used * 100) / u.size));
+        if (u.queue_size) {
+            printf(" %2u/%-2u", u.queue_used, u.queue_size);
+        }
+        else {
+            printf("   -  ");
+        }
+        if (free == 0) {
+            /* created without THREAD_CREATE_STACKTEST, or overflowed */
+            puts(" not painted?");
+        }
+        else if (free < STACK_USAGE_WARN_FREE) {
+            puts(" LOW");
+        }
+        else {
+            puts("");
+        }
+        total += u.size;
+        unused += free;
+    }
+    printf("total %u bytes of thread stacks, %u never used\n",
+           (unsigned)total, (unsigned)unused);
+}
+
+void stack_usage_repaint(void)
+{
+    unsigned state = irq_disable();
+
+    for (kernel_pid_t pid = KERNEL_PID_FIRST; pid <= KERNEL_PID_LAST; pid++) {
+        volatile thread_t *thread = thread_get(pid);
+
+        if (thread == NULL) {
+            continue;
+        }
+
+        /* the saved stack pointer, or for the calling thread the current
+         * frame */
+        uintptr_t top = (pid == thread_getpid()) ?
+                        (uintptr_t)__builtin_frame_address(0) :
+                        (uintptr_t)thread->sp;
+        uintptr_t *p = (uintptr_t *)thread->stack_start;
+        uintptr_t end = (uintptr_t)p + thread->stack_size;
+
+        if (top > end) {
+            top = end;
+        }
+        if (top < (uintptr_t)p + STACK_USAGE_REPAINT_GUARD) {
+            continue;
+        }
+        top -= STACK_USAGE_REPAINT_GUARD;
+        DEBUG("stack_usage: repaint %s %p-%p\n", thread->name, (void *)p,
+              (void *)top);
+        /* same pattern as thread_create() with THREAD_CREATE_STACKTEST */
+        for (; (uintptr_t)p < top; p++) {
+            *p = (uintptr_t)p;
+        }
+    }
+
+    irq_restore(state);
+}
+
+#else /* DEVELHELP */
+
+int stack_usage_get(kernel_pid_t pid, stack_usage_t *usage)
+{
+    (void)pid;
+    (void)usage;
+    return -1;
+}
+
+void stack_usage_print(void)
+{
+    puts("stack_usage: build with DEVELHELP=1");
+}
+
+void stack_usage_repaint(void)
+{
+}
+
+#endif /* DEVELHELP */
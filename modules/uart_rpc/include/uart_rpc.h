@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2018 fcgdam
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @defgroup    ttgo_uart_rpc Framed binary RPC over UART0
+ * @ingroup     boards_esp32_TTGO_LORA_V1
+ * @brief       Binary alternative to the text shell for host test rigs
+ *
+ * Requests and responses use the same frame layout:
+ *
+ *     | 0xA5 | seq | cmd | len | payload (len bytes) | crc16 (LSB first) |
+ *
+ * The CRC is CRC-16/CCITT-FALSE (poly 0x1021, init 0xffff) over seq, cmd,
+ * len and the payload. A response echoes seq, has bit 7 of cmd set and its
+ * first payload byte is the (signed) status returned by the handler.
+ *
+ * Requests are handled strictly in order, and the receive side is buffered,
+ * so a host can pipeline several requests without waiting for the
+ * responses and match them by seq. Frames with a bad CRC are dropped, the
+ * host notices the missing seq. Since the start byte is not an ASCII
+ * character, text printed by handlers on the same UART is skipped by the
+ * host when it looks for the next frame. That only holds for text between
+ * frames: output of another thread can preempt the RPC thread while it
+ * writes a frame and end up inside of it. Applications with threads that
+ * print on their own have to keep them quiet while the endpoint runs, e.g.
+ * with LOG_LEVEL=LOG_NONE for LOG_* output.
+ *
+ * The host side is in dist/tools/uart_rpc.
+ *
+ * @{
+ *
+ * @file
+ * @author      fcgdam <primalcortex.wordpress.com>
+ */
+
+#ifndef UART_RPC_H
+#define UART_RPC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "periph/uart.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief   UART used for the RPC endpoint (GPIO10/GPIO9 on this board)
+ */
+#ifndef UART_RPC_DEV
+#define UART_RPC_DEV            UART_DEV(0)
+#endif
+
+/**
+ * @brief   Baudrate of the RPC endpoint
+ */
+#ifndef UART_RPC_BAUDRATE
+#define UART_RPC_BAUDRATE       (115200U)
+#endif
+
+/**
+ * @brief   Receive buffer size, bounds the number of pipelined requests
+ */
+#ifndef UART_RPC_RX_BUFSIZE
+#define UART_RPC_RX_BUFSIZE     (256U)
+#endif
+
+/**
+ * @brief   Maximum payload length of a frame
+ */
+#ifndef UART_RPC_PAYLOAD_MAX
+#define UART_RPC_PAYLOAD_MAX    (64U)
+#endif
+
+/**
+ * @name    Frame constants
+ * @{
+ */
+#define UART_RPC_SOF            (0xa5)  /**< start of frame */
+#define UART_RPC_RESPONSE       (0x80)  /**< response flag in cmd */
+#define UART_RPC_HDR_LEN        (4U)    /**< sof, seq, cmd, len */
+#define UART_RPC_CRC_LEN        (2U)    /**< crc16 */
+/** @} */
+
+/**
+ * @name    Built-in commands, application commands start at 0x10
+ * @{
+ */
+#define UART_RPC_CMD_PING       (0x00)  /**< echo up to PAYLOAD_MAX - 1 bytes */
+#define UART_RPC_CMD_STATS      (0x01)  /**< frame counters */
+#define UART_RPC_CMD_LIST       (0x02)  /**< names of the registered commands */
+/** @} */
+
+/**
+ * @brief   Command handler
+ *
+ * @param[in]  req      request payload
+ * @param[in]  req_len  request payload length
+ * @param[out] resp     response payload, without the status byte
+ * @param[out] resp_len response payload length, at most
+ *                      UART_RPC_PAYLOAD_MAX - 1, 0 on entry
+ *
+ * @return  status sent back in the response, 0 on success or a negative
+ *          errno value
+ */
+typedef int (*uart_rpc_handler_t)(const uint8_t *req, size_t req_len,
+                                  uint8_t *resp, size_t *resp_len);
+
+/**
+ * @brief   Command registry entry
+ *
+ * Applications define a table of these, terminated by an entry with a NULL
+ * handler, next to their shell_command_t table.
+ */
+typedef struct {
+    uint8_t id;                     /**< command id, 0x10..0x7f */
+    const char *name;               /**< name reported by UART_RPC_CMD_LIST */
+    uart_rpc_handler_t handler;     /**< handler */
+} uart_rpc_command_t;
+
+/**
+ * @brief   Frame counters
+ */
+typedef struct {
+    uint32_t requests;              /**< valid requests handled */
+    uint32_t crc_errors;            /**< frames dropped for a bad CRC */
+    uint32_t unknown;               /**< requests for unknown commands */
+    uint32_t overruns;              /**< bytes lost on a full rx buffer */
+} uart_rpc_stats_t;
+
+/**
+ * @brief   Take over the UART and serve requests forever
+ *
+ * Like shell_run(), this does not return, so applications call either one
+ * of them at the end of main().
+ *
+ * @param[in] commands  command table, terminated by a NULL handler
+ */
+void uart_rpc_run(const uart_rpc_command_t *commands);
+
+/**
+ * @brief   CRC-16/CCITT-FALSE used by the frames
+ */
+uint16_t uart_rpc_crc16(uint16_t crc, const uint8_t *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UART_RPC_H */
+/** @} */
@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2018 fcgdam
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @ingroup     ttgo_uart_rpc
+ * @{
+ *
+ * @file
+ * @brief       Framed binary RPC over UART0 implementation
+ *
+ * @author      fcgdam <primalcortex.wordpress.com>
+ * @}
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "isrpipe.h"
+
+#include "uart_rpc.h"
+
+#define ENABLE_DEBUG (0)
+#include "debug.h"
+
+#define FRAME_MAX   (UART_RPC_HDR_LEN + UART_RPC_PAYLOAD_MAX + UART_RPC_CRC_LEN)
+
+enum {
+    STATE_SOF,
+    STATE_SEQ,
+    STATE_CMD,
+    STATE_LEN,
+    STATE_PAYLOAD,
+    STATE_CRC_LO,
+    STATE_CRC_HI,
+};
+
+typedef struct {
+    uint8_t state;
+    uint8_t seq;
+    uint8_t cmd;
+    uint8_t len;
+    uint8_t pos;
+    uint16_t crc;
+    uint8_t payload[UART_RPC_PAYLOAD_MAX];
+} _parser_t;
+
+static char _rx_buf[UART_RPC_RX_BUFSIZE];
+static isrpipe_t _rx_pipe = ISRPIPE_INIT(_rx_buf);
+static uart_rpc_stats_t _stats;
+static const uart_rpc_command_t *_commands;
+
+static void _rx_cb(void *arg, uint8_t data)
+{
+    (void)arg;
+    if (isrpipe_write_one(&_rx_pipe, (char)data) < 0) {
+        _stats.overruns++;
+    }
+}
+
+uint16_t uart_rpc_crc16(uint16_t crc, const uint8_t *buf, size_t len)
+{
+    while (len--) {
+        crc ^= (uint16_t)(*buf++) << 8;
+        for (unsigned i = 0; i < 8; i++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+static void _respond(uint8_t seq, uint8_t cmd, int status,
+                     const uint8_t *data, size_t len)
+{
+    uint8_t frame[FRAME_MAX];
+
+    frame[0] = UART_RPC_SOF;
+    frame[1] = seq;
+    frame[2] = cmd | UART_RPC_RESPONSE;
+    frame[3] = (uint8_t)(len + 1);
+    frame[4] = (uint8_t)(int8_t)status;
+    if (len) {
+        memcpy(&frame[5], data, len);
+    }
+
+    size_t pos = UART_RPC_HDR_LEN + 1 + len;
+    uint16_t crc = uart_rpc_crc16(0xffff, &frame[1], pos - 1);
+    frame[pos++] = crc & 0xff;
+    frame[pos++] = crc >> 8;
+
+    uart_write(UART_RPC_DEV, frame, pos);
+}
+
+static int _builtin(const _parser_t *p, uint8_t *resp, size_t *resp_len)
+{
+    switch (p->cmd) {
+        case UART_RPC_CMD_PING:
+            /* the response carries the status byte in front of the echo */
+            if (p->len > (UART_RPC_PAYLOAD_MAX - 1)) {
+                return -EOVERFLOW;
+            }
+            memcpy(resp, p->payload, p->len);
+            *resp_len = p->len;
+            return 0;
+        case UART_RPC_CMD_STATS:
+            memcpy(resp, &_stats, sizeof(_stats));
+            *resp_len = sizeof(_stats);
+            return 0;
+        case UART_RPC_CMD_LIST:
+            /* "id name\0" records, as many as fit */
+            for (const uart_rpc_command_t *c = _commands; c->handler; c++) {
+                size_t n = strlen(c->name) + 2;
+                if ((*resp_len + n) > (UART_RPC_PAYLOAD_MAX - 1)) {
+                    break;
+                }
+                resp[(*resp_len)++] = c->id;
+                memcpy(&resp[*resp_len], c->name, n - 1);
+                *resp_len += n - 1;
+            }
+            return 0;
+        default:
+            return -ENOENT;
+    }
+}
+
+static void _dispatch(const _parser_t *p)
+{
+    uint8_t resp[UART_RPC_PAYLOAD_MAX - 1];
+    size_t resp_len = 0;
+    int res = -ENOENT;
+
+    if (p->cmd < 0x10) {
+        res = _builtin(p, resp, &resp_len);
+    }
+    else {
+        for (const uart_rpc_command_t *c = _commands; c->handler; c++) {
+            if (c->id == p->cmd) {
+                res = c->handler(p->payload, p->len, resp, &resp_len);
+                break;
+            }
+        }
+    }
+
+    _stats.requests++;
+    if (res == -ENOENT) {
+        _stats.unknown++;
+    }
+    if (resp_len > sizeof(resp)) {
+        resp_len = 0;
+        res = -EOVERFLOW;
+    }
+    _respond(p->seq, p->cmd, res, resp, resp_len);
+}
+
+static void _parse(_parser_t *p, uint8_t c)
+{
+    switch (p->state) {
+        case STATE_SOF:
+            if (c == UART_RPC_SOF) {
+                p->crc = 0xffff;
+                p->state = STATE_SEQ;
+            }
+            return;
+        case STATE_SEQ:
+            p->seq = c;
+            p->state = STATE_CMD;
+            break;
+        case STATE_CMD:
+            p->cmd = c;
+            p->state = STATE_LEN;
+            break;
+        case STATE_LEN:
+            if (c > UART_RPC_PAYLOAD_MAX) {
+                DEBUG("uart_rpc: frame too long\n");
+                p->state = STATE_SOF;
+                return;
+            }
+            p->len = c;
+            p->pos = 0;
+            p->state = c ? STATE_PAYLOAD : STATE_CRC_LO;
+            break;
+        case STATE_PAYLOAD:
+            p->payload[p->pos++] = c;
+            if (p->pos == p->len) {
+                p->state = STATE_CRC_LO;
+            }
+            break;
+        case STATE_CRC_LO:
+            p->crc ^= c;
+            p->state = STATE_CRC_HI;
+            return;
+        case STATE_CRC_HI:
+            p->state = STATE_SOF;
+            if ((p->crc ^ ((uint16_t)c << 8)) != 0) {
+                DEBUG("uart_rpc: bad crc in frame %u\n", p->seq);
+                _stats.crc_errors++;
+                return;
+            }
+            _dispatch(p);
+            return;
+    }
+    p->crc = uart_rpc_crc16(p->crc, &c, 1);
+}
+
+void uart_rpc_run(const uart_rpc_command_t *commands)
+{
+    _parser_t parser = { .state = STATE_SOF };
+    char buf[32];
+
+    _commands = commands;
+    uart_init(UART_RPC_DEV, UART_RPC_BAUDRATE, _rx_cb, NULL);
+
+    while (1) {
+        int n = isrpipe_read(&_rx_pipe, buf, sizeof(buf));
+        for (int i = 0; i < n; i++) {
+            _parse(&parser, (uint8_t)buf[i]);
+        }
+    }
+}
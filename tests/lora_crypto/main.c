@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2018 fcgdam
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @ingroup     tests
+ * @{
+ *
+ * @file
+ * @brief       Test vectors of the lora_crypto software backend
+ *
+ * FIPS-197, RFC 4493 and a LoRaWAN 1.0 uplink through the public API, so
+ * they also run on native where there is no AES peripheral.
+ *
+ * @author      fcgdam <primalcortex.wordpress.com>
+ * @}
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "embUnit.h"
+
+#include "lora_crypto.h"
+
+/* FIPS-197 appendix C.1 */
+static const uint8_t fips_key[] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+};
+static const uint8_t fips_pt[] = {
+    0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+    0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+};
+static const uint8_t fips_ct[] = {
+    0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+    0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a
+};
+
+/* RFC 4493 section 4, examples 1 to 4 */
+static const uint8_t rfc_key[] = {
+    0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+    0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c
+};
+static const uint8_t rfc_msg[] = {
+    0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96,
+    0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+    0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c,
+    0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+    0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11,
+    0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+    0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17,
+    0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10
+};
+static const struct {
+    uint8_t len;
+    uint8_t mac[LORA_AES_BLOCK_SIZE];
+} rfc_vectors[] = {
+    { 0, { 0xbb, 0x1d, 0x69, 0x29, 0xe9, 0x59, 0x37, 0x28,
+           0x7f, 0xa3, 0x7d, 0x12, 0x9b, 0x75, 0x67, 0x46 } },
+    { 16, { 0x07, 0x0a, 0x16, 0xb4, 0x6b, 0x4d, 0x41, 0x44,
+            0xf7, 0x9b, 0xdd, 0x9d, 0xd0, 0x4a, 0x28, 0x7c } },
+    { 40, { 0xdf, 0xa6, 0x67, 0x47, 0xde, 0x9a, 0xe6, 0x30,
+            0x30, 0xca, 0x32, 0x61, 0x14, 0x97, 0xc8, 0x27 } },
+    { 64, { 0x51, 0xf0, 0xbe, 0xbf, 0x7e, 0x3b, 0x9d, 0x92,
+            0xfc, 0x49, 0x74, 0x17, 0x79, 0x36, 0x3c, 0xfe } },
+};
+#define RFC_NUMOF       (sizeof(rfc_vectors) / sizeof(rfc_vectors[0]))
+
+/* LoRaWAN 1.0 unconfirmed uplink "test" on port 1, FCnt 2, from the
+ * lora-packet reference: 40 F17DBE49 00 0200 01 95437876 2B11FF0D */
+static const uint8_t lw_nwkskey[] = {
+    0x44, 0x02, 0x42, 0x41, 0xed, 0x4c, 0xe9, 0xa6,
+    0x8c, 0x6a, 0x8b, 0xc0, 0x55, 0x23, 0x3f, 0xd3
+};
+static const uint8_t lw_appskey[] = {
+    0xec, 0x92, 0x58, 0x02, 0xae, 0x43, 0x0c, 0xa7,
+    0x7f, 0xd3, 0xdd, 0x73, 0xcb, 0x2c, 0xc5, 0x88
+};
+static const uint8_t lw_frame[] = {
+    0x40, 0xf1, 0x7d, 0xbe, 0x49, 0x00, 0x02, 0x00,
+    0x01, 0x95, 0x43, 0x78, 0x76
+};
+#define LW_DEVADDR      (0x49be7df1UL)
+#define LW_FCNT         (2U)
+#define LW_MIC          (0x0dff112bUL)
+
+static void set_up(void)
+{
+    lora_crypto_set_backend(LORA_CRYPTO_SW);
+}
+
+static void test_aes_fips197(void)
+{
+    lora_aes_ctx_t aes;
+    uint8_t buf[LORA_AES_BLOCK_SIZE];
+
+    lora_aes_setkey(&aes, fips_key);
+    lora_aes_encrypt(&aes, fips_pt, buf);
+    TEST_ASSERT_EQUAL_INT(0, memcmp(buf, fips_ct, sizeof(buf)));
+
+    /* in place, as the CMAC code uses it */
+    memcpy(buf, fips_pt, sizeof(buf));
+    lora_aes_sw_encrypt(&aes, buf, buf);
+    TEST_ASSERT_EQUAL_INT(0, memcmp(buf, fips_ct, sizeof(buf)));
+}
+
+static void test_cmac_rfc4493(void)
+{
+    lora_cmac_t cmac;
+    uint8_t mac[LORA_AES_BLOCK_SIZE];
+
+    for (unsigned i = 0; i < RFC_NUMOF; i++) {
+        lora_cmac_init(&cmac, rfc_key);
+        lora_cmac_update(&cmac, rfc_msg, rfc_vectors[i].len);
+        lora_cmac_final(&cmac, mac);
+        TEST_ASSERT_EQUAL_INT(0, memcmp(mac, rfc_vectors[i].mac, sizeof(mac)));
+    }
+}
+
+static void test_cmac_rfc4493_bytewise(void)
+{
+    lora_cmac_t cmac;
+    uint8_t mac[LORA_AES_BLOCK_SIZE];
+
+    /* every block boundary falls between two updates */
+    for (unsigned i = 0; i < RFC_NUMOF; i++) {
+        lora_cmac_init(&cmac, rfc_key);
+        for (unsigned j = 0; j < rfc_vectors[i].len; j++) {
+            lora_cmac_update(&cmac, &rfc_msg[j], 1);
+        }
+        lora_cmac_final(&cmac, mac);
+        TEST_ASSERT_EQUAL_INT(0, memcmp(mac, rfc_vectors[i].mac, sizeof(mac)));
+    }
+}
+
+static void test_lorawan_mic(void)
+{
+    uint32_t mic = lora_crypto_compute_mic(lw_frame, sizeof(lw_frame),
+                                           lw_nwkskey, LW_DEVADDR,
+                                           LORA_CRYPTO_UPLINK, LW_FCNT);
+
+    TEST_ASSERT_EQUAL_INT(LW_MIC, mic);
+    /* the direction is part of B0 */
+    mic = lora_crypto_compute_mic(lw_frame, sizeof(lw_frame), lw_nwkskey,
+                                  LW_DEVADDR, LORA_CRYPTO_DOWNLINK, LW_FCNT);
+    TEST_ASSERT(mic != LW_MIC);
+}
+
+static void test_lorawan_decrypt(void)
+{
+    uint8_t buf[4];
+
+    lora_crypto_payload_encrypt(&lw_frame[9], sizeof(buf), lw_appskey,
+                                LW_DEVADDR, LORA_CRYPTO_UPLINK, LW_FCNT, buf);
+    TEST_ASSERT_EQUAL_INT(0, memcmp(buf, "test", sizeof(buf)));
+}
+
+static void test_lorawan_encrypt_roundtrip(void)
+{
+    /* several keystream blocks and a partial one */
+    static const char msg[] = "a downlink longer than two AES blocks";
+    uint8_t enc[sizeof(msg)];
+    uint8_t dec[sizeof(msg)];
+
+    lora_crypto_payload_encrypt((const uint8_t *)msg, sizeof(msg), lw_appskey,
+                                LW_DEVADDR, LORA_CRYPTO_DOWNLINK, 7, enc);
+    TEST_ASSERT(memcmp(enc, msg, sizeof(msg)) != 0);
+    lora_crypto_payload_encrypt(enc, sizeof(enc), lw_appskey,
+                                LW_DEVADDR, LORA_CRYPTO_DOWNLINK, 7, dec);
+    TEST_ASSERT_EQUAL_INT(0, memcmp(dec, msg, sizeof(msg)));
+}
+
+static void test_selftest(void)
+{
+    TEST_ASSERT_EQUAL_INT(0, lora_crypto_selftest(LORA_CRYPTO_SW));
+    TEST_ASSERT_EQUAL_INT(LORA_CRYPTO_SW, lora_crypto_get_backend());
+#ifndef LORA_CRYPTO_HAVE_HW
+    TEST_ASSERT_EQUAL_INT(-ENOTSUP, lora_crypto_selftest(LORA_CRYPTO_HW));
+    TEST_ASSERT_EQUAL_INT(-ENOTSUP, lora_crypto_set_backend(LORA_CRYPTO_HW));
+    TEST_ASSERT_EQUAL_INT(LORA_CRYPTO_SW, lora_crypto_get_backend());
+#endif
+}
+
+static Test *tests_lora_crypto(void)
+{
+    EMB_UNIT_TESTFIXTURES(fixtures) {
+        new_TestFixture(test_aes_fips197),
+        new_TestFixture(test_cmac_rfc4493),
+        new_TestFixture(test_cmac_rfc4493_bytewise),
+        new_TestFixture(test_lorawan_mic),
+        new_TestFixture(test_lorawan_decrypt),
+        new_TestFixture(test_lorawan_encrypt_roundtrip),
+        new_TestFixture(test_selftest),
+    };
+
+    EMB_UNIT_TESTCALLER(lora_crypto_tests, set_up, NULL, fixtures);
+
+    return (Test *)&lora_crypto_tests;
+}
+
+int main(void)
+{
+    TESTS_START();
+    TESTS_RUN(tests_lora_crypto());
+    TESTS_END();
+
+    return 0;
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2018 fcgdam
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @ingroup     tests
+ * @{
+ *
+ * @file
+ * @brief       Sampling rate, limits and samples of the profiler
+ *
+ * The unit tests check the number of samples against the rate, the rate
+ * limits and the full buffer. At the end a profile of prof_spin() is
+ * dumped, tests/01-run.py symbolizes it with dist/tools/profiler and
+ * checks that the samples land in prof_spin().
+ *
+ * @author      fcgdam <primalcortex.wordpress.com>
+ * @}
+ */
+
+#include <errno.h>
+
+#include "embUnit.h"
+#include "xtimer.h"
+
+#include "profiler.h"
+
+#define SPIN_US         (200U * US_PER_MS)
+
+static void __attribute__((noinline)) prof_spin(uint32_t usec)
+{
+    uint32_t start = xtimer_now_usec();
+
+    while (xtimer_now_usec() - start < usec) {
+        for (volatile unsigned i = 0; i < 1000; i++) {}
+    }
+}
+
+static void tear_down(void)
+{
+    profiler_stop();
+}
+
+static void test_rate(void)
+{
+    TEST_ASSERT_EQUAL_INT(0, profiler_start(1000));
+    prof_spin(SPIN_US);
+    profiler_stop();
+
+    /* 200 samples on average, the host may delay the timer signals */
+    unsigned count = profiler_count();
+    TEST_ASSERT(count >= 100);
+    TEST_ASSERT(count <= 300);
+
+    /* stopped, the samples stay */
+    prof_spin(20U * US_PER_MS);
+    TEST_ASSERT_EQUAL_INT(count, profiler_count());
+}
+
+static void test_limits(void)
+{
+    TEST_ASSERT_EQUAL_INT(-EINVAL, profiler_start(PROFILER_MAX_HZ + 1));
+    TEST_ASSERT_EQUAL_INT(0, profiler_start(0));
+    profiler_stop();
+
+    /* never faster than PROFILER_MIN_PERIOD_US */
+    TEST_ASSERT_EQUAL_INT(0, profiler_start(PROFILER_MAX_HZ));
+    prof_spin(50U * US_PER_MS);
+    profiler_stop();
+    TEST_ASSERT(profiler_count() > 0);
+    TEST_ASSERT(profiler_count() <= (50U * US_PER_MS) / PROFILER_MIN_PERIOD_US);
+}
+
+static void test_full(void)
+{
+    /* twice the samples the buffer holds */
+    uint32_t usec = 2 * PROFILER_SAMPLES * (US_PER_SEC / PROFILER_MAX_HZ);
+
+    TEST_ASSERT_EQUAL_INT(0, profiler_start(PROFILER_MAX_HZ));
+    prof_spin(usec);
+    TEST_ASSERT_EQUAL_INT(PROFILER_SAMPLES, profiler_count());
+
+    /* sampling stopped by itself */
+    prof_spin(20U * US_PER_MS);
+    TEST_ASSERT_EQUAL_INT(PROFILER_SAMPLES, profiler_count());
+}
+
+static Test *tests_profiler(void)
+{
+    EMB_UNIT_TESTFIXTURES(fixtures) {
+        new_TestFixture(test_rate),
+        new_TestFixture(test_limits),
+        new_TestFixture(test_full),
+    };
+
+    EMB_UNIT_TESTCALLER(profiler_tests, NULL, tear_down, fixtures);
+
+    return (Test *)&profiler_tests;
+}
+
+int main(void)
+{
+    TESTS_START();
+    TESTS_RUN(tests_profiler());
+    TESTS_END();
+
+    /* for the symbolizer in tests/01-run.py */
+    profiler_start(PROFILER_DEFAULT_HZ);
+    prof_spin(SPIN_US);
+    profiler_dump();
+
+    return 0;
+}
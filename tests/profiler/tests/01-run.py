@@ -0,0 +1,40 @@
+#!/usr/bin/env python3
+
+# Copyright (C) 2018 fcgdam
+#
+# This file is subject to the terms and conditions of the GNU Lesser
+# General Public License v2.1. See the file LICENSE in the top level
+# directory for more details.
+
+import io
+import os
+import sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                '..', '..', '..', 'dist', 'tools', 'profiler'))
+import symbolize  # noqa: E402
+
+
+def testfunc(child):
+    child.expect(r'OK \(\d+ tests\)')
+    child.expect(r'PROF begin')
+    child.expect(r'PROF end')
+    log = 'PROF begin' + child.before + 'PROF end\n'
+    profile = symbolize.read_profiles(io.StringIO(log))[0]
+    assert profile.samples, "no samples"
+
+    elf = os.environ['ELFFILE']
+    syms = symbolize.Symbols(elf, symbolize.tool('nm', elf, None))
+    offset = int(profile.info['base'], 16) - syms.by_name['profiler_dump']
+    stacks = symbolize.folded(profile, syms, None, offset)
+    spin = sum(count for frames, count in stacks.items()
+               if frames[0] == 'main' and frames[-1].startswith('prof_spin'))
+    total = sum(stacks.values())
+    print("%d of %d samples in prof_spin" % (spin, total))
+    assert spin * 2 > total, "prof_spin is not the top function"
+
+
+if __name__ == "__main__":
+    sys.path.append(os.path.join(os.environ['RIOTBASE'], 'dist/pythonlibs'))
+    from testrunner import run
+    sys.exit(run(testfunc))
@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2018 fcgdam
+ *
+ * This file is subject to the terms and conditions of the GNU Lesser
+ * General Public License v2.1. See the file LICENSE in the top level
+ * directory for more details.
+ */
+
+/**
+ * @ingroup     tests
+ * @{
+ *
+ * @file
+ * @brief       Save, simulated reset and restore of rtc_retain
+ *
+ * Runs in three boots: the cold boot saves a LoRaWAN session and sleeps,
+ * the first wake up checks it, counts an uplink and sleeps again, the
+ * second one checks the counters. The stage is part of the retained
+ * state. On native each sleep is a pm_reboot() of the process.
+ *
+ * @author      fcgdam <primalcortex.wordpress.com>
+ * @}
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "embUnit.h"
+#include "timex.h"
+
+#include "rtc_retain.h"
+
+#define SLEEP_1_MS      (1500U)
+#define SLEEP_2_MS      (2500U)
+
+/* the parts of the RIOT_TTGO_TTN state the tests can tell apart */
+typedef struct {
+    uint32_t devaddr;
+    uint8_t appskey[16];
+    uint8_t nwkskey[16];
+    uint32_t fcnt_up;
+    uint32_t fcnt_down;
+    uint32_t net_id;
+    uint8_t cls;
+    uint8_t rx1_dr_offset;
+    uint32_t time_off_ms;
+    uint8_t stage;
+} state_t;
+
+static const state_t session = {
+    .devaddr = 0x260112abUL,
+    .appskey = { 0xec, 0x92, 0x58, 0x02, 0xae, 0x43, 0x0c, 0xa7,
+                 0x7f, 0xd3, 0xdd, 0x73, 0xcb, 0x2c, 0xc5, 0x88 },
+    .nwkskey = { 0x44, 0x02, 0x42, 0x41, 0xed, 0x4c, 0xe9, 0xa6,
+                 0x8c, 0x6a, 0x8b, 0xc0, 0x55, 0x23, 0x3f, 0xd3 },
+    .fcnt_up = 41,
+    .fcnt_down = 7,
+    .net_id = 0x000013,
+    .cls = 2,
+    .rx1_dr_offset = 1,
+    .time_off_ms = 5052,
+};
+
+static state_t state;
+
+/* the session without the fields the stages change */
+static int _same_session(const state_t *a, const state_t *b)
+{
+    return a->devaddr == b->devaddr &&
+           memcmp(a->appskey, b->appskey, sizeof(a->appskey)) == 0 &&
+           memcmp(a->nwkskey, b->nwkskey, sizeof(a->nwkskey)) == 0 &&
+           a->fcnt_down == b->fcnt_down && a->net_id == b->net_id &&
+           a->cls == b->cls && a->rx1_dr_offset == b->rx1_dr_offset &&
+           a->time_off_ms == b->time_off_ms;
+}
+
+static void test_cold(void)
+{
+    rtc_retain_info_t info;
+
+    TEST_ASSERT_EQUAL_INT(RTC_RETAIN_COLD, rtc_retain_boot());
+    TEST_ASSERT_EQUAL_INT(-ENOENT, rtc_retain_restore(&state, sizeof(state)));
+    rtc_retain_get_info(&info);
+    TEST_ASSERT_EQUAL_INT(0, info.wakes);
+    TEST_ASSERT_EQUAL_INT(0, info.slept_ms);
+}
+
+static void test_save_too_large(void)
+{
+    TEST_ASSERT_EQUAL_INT(-EINVAL, rtc_retain_save(&state, RTC_RETAIN_SIZE + 1));
+}
+
+static void test_clear(void)
+{
+    /* dropped, but this boot stays cold */
+    TEST_ASSERT_EQUAL_INT(0, rtc_retain_save(&session, sizeof(session)));
+    rtc_retain_clear();
+    TEST_ASSERT_EQUAL_INT(RTC_RETAIN_COLD, rtc_retain_boot());
+    TEST_ASSERT_EQUAL_INT(-ENOENT, rtc_retain_restore(&state, sizeof(state)));
+}
+
+static Test *tests_rtc_retain_cold(void)
+{
+    EMB_UNIT_TESTFIXTURES(fixtures) {
+        new_TestFixture(test_cold),
+        new_TestFixture(test_save_too_large),
+        new_TestFixture(test_clear),
+    };
+
+    EMB_UNIT_TESTCALLER(rtc_retain_cold_tests, NULL, NULL, fixtures);
+
+    return (Test *)&rtc_retain_cold_tests;
+}
+
+static void test_warm_session(void)
+{
+    TEST_ASSERT_EQUAL_INT(RTC_RETAIN_WARM, rtc_retain_boot());
+    TEST_ASSERT_EQUAL_INT(0, rtc_retain_restore(&state, sizeof(state)));
+    TEST_ASSERT(_same_session(&state, &session));
+}
+
+static void test_warm_size_mismatch(void)
+{
+    state_t other;
+
+    /* another firmware layout is no resume */
+    TEST_ASSERT_EQUAL_INT(-EINVAL, rtc_retain_restore(&other, sizeof(other) - 1));
+}
+
+static void test_warm_1(void)
+{
+    rtc_retain_info_t info;
+
+    TEST_ASSERT_EQUAL_INT(1, state.stage);
+    TEST_ASSERT_EQUAL_INT(session.fcnt_up, state.fcnt_up);
+    rtc_retain_get_info(&info);
+    TEST_ASSERT_EQUAL_INT(1, info.wakes);
+    TEST_ASSERT_EQUAL_INT(SLEEP_1_MS, info.slept_ms);
+}
+
+static void test_warm_2(void)
+{
+    rtc_retain_info_t info;
+
+    TEST_ASSERT_EQUAL_INT(2, state.stage);
+    /* the uplink of the first wake up is counted */
+    TEST_ASSERT_EQUAL_INT(session.fcnt_up + 1, state.fcnt_up);
+    rtc_retain_get_info(&info);
+    TEST_ASSERT_EQUAL_INT(2, info.wakes);
+    TEST_ASSERT_EQUAL_INT(SLEEP_1_MS + SLEEP_2_MS, info.slept_ms);
+}
+
+static Test *tests_rtc_retain_warm(void)
+{
+    EMB_UNIT_TESTFIXTURES(fixtures) {
+        new_TestFixture(test_warm_session),
+        new_TestFixture(test_warm_size_mismatch),
+        new_TestFixture(test_warm_1),
+    };
+
+    EMB_UNIT_TESTCALLER(rtc_retain_warm_tests, NULL, NULL, fixtures);
+
+    return (Test *)&rtc_retain_warm_tests;
+}
+
+static Test *tests_rtc_retain_counters(void)
+{
+    EMB_UNIT_TESTFIXTURES(fixtures) {
+        new_TestFixture(test_warm_session),
+        new_TestFixture(test_warm_2),
+    };
+
+    EMB_UNIT_TESTCALLER(rtc_retain_counters_tests, NULL, NULL, fixtures);
+
+    return (Test *)&rtc_retain_counters_tests;
+}
+
+int main(void)
+{
+    rtc_retain_boot_t boot = rtc_retain_boot();
+
+    /* the stage of a warm boot is in the retained state */
+    if (boot == RTC_RETAIN_WARM) {
+        rtc_retain_restore(&state, sizeof(state));
+    }
+    printf("boot %d stage %d\n", (int)boot, (int)state.stage);
+
+    TESTS_START();
+    if (boot != RTC_RETAIN_WARM) {
+        TESTS_RUN(tests_rtc_retain_cold());
+        TESTS_END();
+        state = session;
+        state.stage = 1;
+        rtc_retain_save(&state, sizeof(state));
+        rtc_retain_sleep(SLEEP_1_MS * US_PER_MS);
+    }
+    else if (state.stage == 1) {
+        TESTS_RUN(tests_rtc_retain_warm());
+        TESTS_END();
+        state.fcnt_up++;
+        state.stage = 2;
+        rtc_retain_save(&state, sizeof(state));
+        rtc_retain_sleep(SLEEP_2_MS * US_PER_MS);
+    }
+    else {
+        TESTS_RUN(tests_rtc_retain_counters());
+        TESTS_END();
+        /* the next start is a cold one again */
+        rtc_retain_clear();
+        puts("rtc_retain: done");
+    }
+
+    return 0;
+}
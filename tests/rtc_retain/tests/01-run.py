@@ -0,0 +1,33 @@
+#!/usr/bin/env python3
+
+# Copyright (C) 2018 fcgdam
+#
+# This file is subject to the terms and conditions of the GNU Lesser
+# General Public License v2.1. See the file LICENSE in the top level
+# directory for more details.
+
+import os
+import sys
+
+# the RTC memory of native, in the directory the application runs in
+RTC_FILE = 'rtc_retain.bin'
+
+
+def testfunc(child):
+    # every stage is a boot of its own, the reset must not lose the output
+    child.expect_exact('boot 0 stage 0')
+    child.expect(r'OK \(3 tests\)')
+    child.expect_exact('boot 1 stage 1')
+    child.expect(r'OK \(3 tests\)')
+    child.expect_exact('boot 1 stage 2')
+    child.expect(r'OK \(2 tests\)')
+    child.expect_exact('rtc_retain: done')
+
+
+if __name__ == "__main__":
+    # a run stopped between two stages would start warm
+    if os.path.exists(RTC_FILE):
+        os.remove(RTC_FILE)
+    sys.path.append(os.path.join(os.environ['RIOTBASE'], 'dist/pythonlibs'))
+    from testrunner import run
+    sys.exit(run(testfunc))